@@ -0,0 +1,168 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Allocator benchmark: runs fixed workloads against
+// student_malloc/student_free and prints one line per run,
+//   allocbench,<workload>,<run>,<ops>,<ticks>
+// and one summary line per workload,
+//   allocbench-avg,<workload>,<runs>,<ops>,<ticks>
+// where ops counts mallocs plus frees and ticks is uptime().
+//
+// allocbench [-n runs] [workload]
+
+#define NSLOT   512    // live blocks a workload keeps at most
+#define ROUNDS  20000  // mallocs per run
+
+static void *slot[NSLOT];
+static unsigned int seed;
+
+static unsigned int
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) & 0x7fff;
+}
+
+// Uniform small objects: fill all slots with 64-byte blocks,
+// then keep replacing random ones.
+static int
+uniform_small(void)
+{
+  int i, j, ops = 0;
+
+  for(i = 0; i < NSLOT; i++, ops++)
+    slot[i] = student_malloc(64);
+  for(i = NSLOT; i < ROUNDS; i++, ops += 2) {
+    j = rnd() % NSLOT;
+    student_free(slot[j]);
+    slot[j] = student_malloc(64);
+  }
+  for(i = 0; i < NSLOT; i++, ops++)
+    student_free(slot[i]);
+  return ops;
+}
+
+// Mixed sizes: like uniform_small, but sizes are mostly small
+// with some page-sized and a few multi-page blocks.
+static uint
+mixed_size(void)
+{
+  uint r = rnd() % 100;
+
+  if(r < 70)
+    return 8 + rnd() % 256;
+  if(r < 95)
+    return 256 + rnd() % 3840;
+  return 4096 + rnd() % 28672;
+}
+
+static int
+mixed(void)
+{
+  int i, j, ops = 0;
+
+  for(i = 0; i < NSLOT; i++, ops++)
+    slot[i] = student_malloc(mixed_size());
+  for(i = NSLOT; i < ROUNDS; i++, ops += 2) {
+    j = rnd() % NSLOT;
+    student_free(slot[j]);
+    slot[j] = student_malloc(mixed_size());
+  }
+  for(i = 0; i < NSLOT; i++, ops++)
+    student_free(slot[i]);
+  return ops;
+}
+
+// Producer/consumer churn: blocks go into a FIFO as they are
+// made and are freed oldest first, so frees never happen in the
+// order of the allocator's free lists.
+static int
+churn(void)
+{
+  int head = 0, tail = 0, ops = 0;
+  int i, k;
+
+  for(i = 0; i < ROUNDS; ) {
+    // producer: a burst of 1..32 blocks, as long as there's room
+    for(k = 1 + rnd() % 32; k > 0 && head - tail < NSLOT && i < ROUNDS; k--, i++, ops++)
+      slot[head++ % NSLOT] = student_malloc(16 + rnd() % 512);
+    // consumer: a burst of 1..32 frees
+    for(k = 1 + rnd() % 32; k > 0 && tail < head; k--, ops++)
+      student_free(slot[tail++ % NSLOT]);
+  }
+  while(tail < head) {
+    student_free(slot[tail++ % NSLOT]);
+    ops++;
+  }
+  return ops;
+}
+
+// Grow then free: allocate ever larger blocks until NSLOT are
+// live, then free them all, newest first.
+static int
+grow(void)
+{
+  int i, r, ops = 0;
+
+  for(r = 0; r < ROUNDS / NSLOT; r++) {
+    for(i = 0; i < NSLOT; i++, ops++)
+      slot[i] = student_malloc(16 + i * 32);
+    for(i = NSLOT - 1; i >= 0; i--, ops++)
+      student_free(slot[i]);
+  }
+  return ops;
+}
+
+struct workload {
+  char *name;
+  int (*run)(void);
+};
+
+static struct workload workloads[] = {
+  { "uniform_small", uniform_small },
+  { "mixed",         mixed },
+  { "churn",         churn },
+  { "grow",          grow },
+};
+#define NWORKLOAD (sizeof(workloads) / sizeof(workloads[0]))
+
+int
+main(int argc, char *argv[])
+{
+  int runs = 3, i, r, ops, t0, ticks;
+  int total_ops, total_ticks;
+  char *only = 0;
+
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if(argv[i][0] != '-' && only == 0) {
+      only = argv[i];
+    } else {
+      fprintf(2, "usage: allocbench [-n runs] [workload]\n");
+      exit(1);
+    }
+  }
+  if(runs < 1)
+    runs = 1;
+
+  for(i = 0; i < NWORKLOAD; i++) {
+    if(only && strcmp(only, workloads[i].name) != 0)
+      continue;
+    total_ops = total_ticks = 0;
+    for(r = 0; r < runs; r++) {
+      seed = 1 + r; // same sequence for every allocator version
+      t0 = uptime();
+      ops = workloads[i].run();
+      ticks = uptime() - t0;
+      printf("allocbench,%s,%d,%d,%d\n", workloads[i].name, r, ops, ticks);
+      total_ops += ops;
+      total_ticks += ticks;
+    }
+    printf("allocbench-avg,%s,%d,%d,%d\n", workloads[i].name, runs,
+           total_ops / runs, total_ticks / runs);
+  }
+
+  exit(0);
+}
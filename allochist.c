@@ -0,0 +1,92 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/allochist.h"
+#include "user/user.h"
+
+// Print the kernel's allocator histograms with percentiles.
+// allochist      show the counts since boot (or the last reset)
+// allochist -r   show them, then clear them
+
+static char *names[NHIST] = {
+  [HIST_MALLOC_SIZE] "student_malloc size (bytes)",
+  [HIST_MALLOC_TIME] "student_malloc latency (ticks)",
+  [HIST_FREE_TIME]   "student_free latency (ticks)",
+  [HIST_KALLOC_TIME] "kalloc latency (ticks)",
+};
+
+// Percentiles in tenths of a percent
+#define NPCT 4
+static int pcts[NPCT] = { 500, 900, 990, 999 };
+
+// Upper bound of bucket b
+static uint64
+bound(int b)
+{
+  return 1UL << (b + 1);
+}
+
+static void
+show(char *name, uint64 *count)
+{
+  uint64 total = 0, sum = 0;
+  int b, i, last = 0;
+
+  for(b = 0; b < HIST_NBUCKET; b++) {
+    total += count[b];
+    if(count[b])
+      last = b;
+  }
+  printf("%s: n=%lu", name, total);
+  if(total == 0) {
+    printf("\n\n");
+    return;
+  }
+
+  // Values are only known to the bucket, so report its upper bound
+  i = 0;
+  for(b = 0; b < HIST_NBUCKET && i < NPCT; b++) {
+    sum += count[b];
+    for(; i < NPCT && sum * 1000 >= total * pcts[i]; i++) {
+      if(pcts[i] % 10)
+        printf(" p%d.%d<%lu", pcts[i] / 10, pcts[i] % 10, bound(b));
+      else
+        printf(" p%d<%lu", pcts[i] / 10, bound(b));
+    }
+  }
+  printf(" max<%lu\n", bound(last));
+
+  for(b = 0; b < HIST_NBUCKET; b++) {
+    if(count[b] == 0)
+      continue;
+    printf("  [%lu, %lu) %lu\t", b ? bound(b - 1) : 0, bound(b), count[b]);
+    for(i = 0; i < (count[b] * 40 + total - 1) / total; i++)
+      printf("#");
+    printf("\n");
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct allochist h;
+  int reset = 0;
+
+  if(argc == 2 && strcmp(argv[1], "-r") == 0) {
+    reset = 1;
+  } else if(argc != 1) {
+    fprintf(2, "usage: allochist [-r]\n");
+    exit(1);
+  }
+
+  if(allochist(&h, reset) < 0) {
+    fprintf(2, "allochist: failed\n");
+    exit(1);
+  }
+  for(int i = 0; i < NHIST; i++)
+    show(names[i], h.count[i]);
+  if(reset)
+    printf("(counts cleared)\n");
+
+  exit(0);
+}
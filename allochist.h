@@ -0,0 +1,16 @@
+// Log2 histograms of allocator request sizes and latencies,
+// read (and optionally cleared) with the allochist() system
+// call. Bucket i counts values v with 2^i <= v < 2^(i+1);
+// bucket 0 also counts 0 and the last bucket everything
+// bigger. Latencies are in r_time() ticks.
+#define HIST_NBUCKET 32
+
+#define HIST_MALLOC_SIZE 0 // bytes asked of student_malloc
+#define HIST_MALLOC_TIME 1 // student_malloc latency
+#define HIST_FREE_TIME   2 // student_free latency
+#define HIST_KALLOC_TIME 3 // kalloc latency
+#define NHIST            4
+
+struct allochist {
+  uint64 count[NHIST][HIST_NBUCKET];
+};
@@ -2,6 +2,9 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct memstats;
+struct allochist;
+struct procmem;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -56,15 +59,43 @@ void            itrunc(struct inode*);
 void            ireclaim(int);
 
 // kalloc.c
+extern uint64   phystop;
 void*           kalloc(void);
 void            kfree(void *);
+void*           kalloc_pages(int);
+void            kfree_pages(void *, int);
+void*           kalloc_super(void);
+void            kfree_super(void *);
+int             super_split(pagetable_t, uint64);
+void*           kalloc_zeroed(void);
+int             kalloc_batch(void **, int);
+void            kfree_batch(void *);
+void            kzero_idle(void);
+uint64          fault_around(struct proc*, uint64);
+void            kref_get(void *);
+int             kref_count(void *);
+int             uvmshare(pagetable_t, pagetable_t, uint64);
+int             cow_fault(pagetable_t, uint64);
+int             shm_get(struct proc*, int, int);
+uint64          shm_attach(struct proc*, int);
+int             shm_detach(struct proc*, uint64);
 void            kinit(void); 
 //added function declaration here
-void*           student_malloc(uint);
-void            student_free(void*);
+uint64          student_malloc(struct proc*, uint);
+int             student_free(struct proc*, uint64);
+int             student_malloc_batch(struct proc*, uint*, uint64*, int);
+int             student_free_batch(struct proc*, uint64*, int);
+void            student_unmap(pagetable_t);
+void            student_exit(struct proc*);
+int             student_strategy(struct proc*, int);
 void            student_init(void);
 uint            student_stats(void);
 void            student_get_stats(uint*, uint*, uint*, uint*, uint*);
+void            student_memstats(struct memstats*);
+void            allochist_read(struct allochist*, int);
+void            statpage_update(void);
+int             statpage_map(pagetable_t);
+int             memacct_read(int, struct procmem*);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -1,6 +1,7 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. Allocates whole 4096-byte pages,
+// or power-of-two runs of contiguous pages.
 
 #include "types.h"
 #include "param.h"
@@ -8,58 +9,780 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "proc.h"
+#include "student.h"
+#include "memstats.h"
+#include "allochist.h"
 
 void freerange(void *pa_start, void *pa_end);
+static void *kzero_get(void);
+static void hist_add(int h, uint64 v);
+static int student_reclaim(int n);
+static int student_trim(uint keep);
+static pte_t *leaf_pte(pagetable_t pagetable, uint64 va, int *level);
+static int kref_put(void *pa);
+static void unshare(pagetable_t new, uint64 va);
+static int map_super(pagetable_t pagetable, uint64 va, char *pa, int perm);
+static void shm_release(struct proc *p, int id);
+static uint64 dtb_memtop(uint64 dtb);
+static void pginfo_clear(uint64 lo, uint64 hi);
 
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// The end of RAM. kinit() reads it from the device tree QEMU
+// passes at boot, so all the memory given with -m is used, and
+// sizes the per-page tables below to match. PHYSTOP is only the
+// fallback when there is no device tree.
+uint64 phystop;
+uint64 dtb; // physical address of the device tree, stored by entry.S
+
+// The page every process sees at USTATS, see statpage_update().
+// kinit() gives it a page of its own after the per-page tables.
+struct memstats_page *statpage;
+
+// kmem is a binary buddy allocator. Free memory is kept in
+// blocks of 2^k pages, k = 0..MAXORDER, each aligned to its own
+// size relative to KERNBASE, so the buddy of a block is found
+// by flipping one bit of its page number. kmem.free[k] lists
+// the free blocks of order k, and kmem.info[] marks the first
+// page of every free block with its order so a freed block
+// can check whether its buddy is free and merge with it.
+#define MAXORDER 10                             // largest block is 2^10 pages (4 MB)
+#define NPAGES ((phystop - KERNBASE) / PGSIZE)
+#define BUDDY_FREE 0x80                         // kmem.info[]: first page of a free block
+#define PA2PG(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define PG2PA(pg) (KERNBASE + (uint64)(pg) * PGSIZE)
+#define SUPERORDER 9                            // a 2 MB megapage is 2^9 pages
+#define SUPERPGSIZE ((uint64)PGSIZE << SUPERORDER)
+
+// Flattened device tree tokens, see dtb_memtop()
+#define FDT_MAGIC      0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE   2
+#define FDT_PROP       3
+#define FDT_NOP        4
+
 struct run {
   struct run *next;
+  struct run *prev; // only maintained on the kmem.free[] lists
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *free[MAXORDER+1];
+  uint nfree;  // pages on the free[] lists or above top
+  uint npages; // pages given to kmem by kinit
+  uint64 top;  // memory from top to limit is free but untouched,
+  uint64 limit; // see buddy_grow()
+  uchar *info; // NPAGES entries, placed by kinit
 } kmem;
 
+// Per-CPU page caches in front of kmem. kalloc() and kfree()
+// normally touch only the running CPU's list; single pages move
+// to and from the buddy allocator KCACHE_BATCH at a time, so
+// kmem.lock is taken once per batch instead of once per page.
+// Each cache has its own lock because other CPUs may steal
+// from it when both their cache and kmem are empty.
+#define KCACHE_BATCH 32               // pages per refill/drain
+#define KCACHE_HIGH  (2*KCACHE_BATCH) // drain when a cache grows past this
+
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+};
+
+struct kcache kcache[NCPU];
+
+// Pages are only filled with junk on kfree()/kalloc() in
+// KALLOC_DEBUG builds (make KALLOC_DEBUG=1); that catches
+// dangling references but writes every page twice per round
+// trip. Callers that want a clean page use kalloc_zeroed(),
+// which takes one from kzero, a pool of pages that idle CPUs
+// have already cleared (see kzero_idle).
+#ifdef KALLOC_DEBUG
+#define JUNK(pa, n, c) memset((pa), (c), (n))
+#else
+#define JUNK(pa, n, c)
+#endif
+
+// Size and latency histograms, one set per CPU so recording
+// a value never contends with another CPU (see hist_add).
+struct allochist cpuhist[NCPU];
+
+#define KZERO_TARGET 64 // pages idle CPUs keep zeroed
+#define KZERO_BATCH  8  // pages zeroed per kzero_idle() call
+
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+} kzero;
+
+// Pages shared by several page tables, for copy-on-write fork,
+// have a reference count. kref.count[] holds the references
+// beyond the first, indexed by page number, so a page that only
+// one owner knows about (every other page, and any page kalloc
+// hands out) counts 0 and kfree() frees it without taking
+// kref.lock. Only the pages from end to phystop are ever counted.
+#define KREF_MAX 255
+
+struct {
+  struct spinlock lock;
+  uchar *count; // NPAGES entries, placed by kinit
+} kref;
+
+// A PTE of a page shared copy-on-write is read-only and has
+// this bit, one of the two the hardware leaves for software.
+#define PTE_COW (1L << 8)
+
+// Fault-around for memory grown lazily with sbrklazy(): a page
+// fault maps the page and up to window - 1 pages after it, all
+// taken from kalloc in one batch (see fault_around). A process's
+// window doubles, up to FAULT_AROUND_MAX, each time a fault lands
+// right where the previous window ended, as in a linear scan,
+// and starts over at FAULT_AROUND_MIN otherwise.
+// make FAULTAROUND=n sets the largest window; 1 turns it off.
+#ifndef FAULT_AROUND_MAX
+#define FAULT_AROUND_MAX 64
+#endif
+#define FAULT_AROUND_MIN 4
+
+struct faultaround {
+  int pid;      // process the window belongs to
+  int window;   // pages the next fault maps
+  uint64 next;  // first page past the last window
+};
+
+struct {
+  struct faultaround proc[NPROC]; // indexed like proc[]
+  uint64 nfault;                  // faults handled, kept with atomics
+  uint64 npages;                  // pages they mapped
+} lazy;
+
+// Per-process memory accounting for procmem(), indexed like
+// proc[]. The numbers are counted by walking the page table
+// when procmem() asks for them (see memacct_read()), and kept
+// here for when the process is running on another CPU and its
+// page table can't be walked.
+struct procacct {
+  uint64 resident; // user pages mapped
+  uint64 shared;   // of those, shared with other page tables
+  uint64 ptpages;  // page-table pages
+  uint64 lazy;     // bytes below p->sz not mapped yet
+};
+
+struct {
+  struct procacct proc[NPROC];
+} memacct;
+
+// Shared memory segments, see shm_get(). A segment keeps the
+// pages it took from kalloc() until the last process holding it
+// lets go; every process that attaches it maps the same pages
+// and takes a kref on each, so kfree() of its mappings just
+// drops those. held[] and mapped[] are bitmasks of segment ids,
+// indexed like proc[].
+#define SHM_MAXPAGES (SHM_MAXSIZE / PGSIZE)
+
+struct shmseg {
+  int key;        // 0 if the slot is free
+  int npages;
+  int nheld;      // processes holding it
+  char *pages[SHM_MAXPAGES];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+  ushort held[NPROC];
+  ushort mapped[NPROC];
+} shm;
+
 // Custom allocator definitions
 #define DEFAULT_BLOCK_SIZE 768
-#define ALLOCATION_STRATEGY 1  // 1 = best-fit
+#define ALLOCATION_STRATEGY STRATEGY_BEST_FIT // default for every process, see student_strategy()
 #define ALIGNMENT 3 // 8-byte alignment, i.e., 2^3 = 8, power-of-2 alignments for memory
 #define FREE_LIST_SIZE 20
+#define STUDENT_HIGH_WATER (2 * FREE_LIST_SIZE) // reserve is trimmed back to FREE_LIST_SIZE past this
+#define ARENA_FREE_MAX 8                        // free pages an arena keeps for itself
 #define MAGIC_NUMBER 16
 
+// Student allocator pages are mapped into the address space of
+// the process that got memory from them, at USTUDENT + (pa - KERNBASE),
+// so user code can use the memory directly. It can also overwrite
+// anything in those pages, so the allocator keeps nothing there that
+// it relies on: what each page is used for is recorded in its
+// struct block_header in student_pages[], indexed by page number.
+#define BLK_NONE  0 // not a student page, or inside a block
+#define BLK_FREE  1 // on an arena's or student_mem's free list
+#define BLK_BLOCK 2 // first page of an allocated block of npages pages
+#define BLK_SLAB  3 // carved into slab objects
+#define BLK_META  4 // an arena's slab descriptors, never mapped
+#define BLK_HEAP  5 // part of a heap chunk
+#define BLK_HMETA 6 // an arena's heap descriptors, never mapped
+
 struct block_header {
-  uint size;        // User's requested size
-  uint magic;       // Magic number (16)
-  uint allocated;   // 1 if allocated, 0 if free
-  struct block_header* next; // Next block in free list
+  uint size;        // User's requested size (BLK_BLOCK), arena's gen (BLK_HMETA)
+  ushort kind;      // BLK_*
+  ushort npages;    // pages in the block, 1 for any other kind
+  union {
+    struct block_header* next; // Next free page (BLK_FREE)
+    struct slab* slab;         // the slab's descriptor (BLK_SLAB)
+    struct block_header* chunk; // first page of the chunk (BLK_HEAP)
+    struct arena* arena;       // the descriptors' arena (BLK_HMETA)
+  };
+  struct block_header* onext;  // arena's owned list, or student_mem.reclaim
+  struct block_header* oprev;
 };
 
-struct { // Student memory allocator state
+struct block_header *student_pages; // NPAGES entries, placed by kinit
+
+#define PGHDR(pa) (&student_pages[PA2PG(pa)])
+#define HDRPAGE(b) ((char*)PG2PA((b) - student_pages))
+#define UVA(pa) (USTUDENT + ((uint64)(pa) - KERNBASE))
+#define KVA(va) ((char*)((va) - USTUDENT + KERNBASE))
+
+// Slab layer for small requests. A slab is one page carved
+// into equal-size objects of one size class; every object
+// starts with a struct slab_obj holding the requested size for
+// the statistics. User code can change that, so it is trusted no
+// further than the class size. Which objects are handed out is
+// tracked in the slab's descriptor, which is kernel-only memory.
+// Requests up to SLAB_MAX bytes are packed into slabs; bigger
+// ones get whole pages to themselves.
+#define SLAB_KEEP_EMPTY 1     // empty slabs kept per class before returning the page
+
+struct slab_obj {
+  uint size;   // User's requested size
+  uint magic;  // Magic number (16)
+};
+
+struct slab {
+  struct slab *next;     // class partial/full/empty list, or unused descriptors
+  struct slab *prev;
+  char *page;            // the objects
+  ushort cls;            // index into slab_size[]
+  ushort inuse;          // objects handed out
+  uint64 used[4];        // bit i set while object i is handed out
+};
+
+// Object sizes, header included. Each packs a page with
+// little left over, e.g. 2 x 2048, 3 x 1360, 7 x 584, 64 x 64.
+static const ushort slab_size[] = {
+  16, 32, 48, 64, 96, 128, 192, 256, 336, 448, 584, 680, 816, 1024, 1360, 2048
+};
+#define NSLABCLASS NELEM(slab_size)
+#define SLAB_MAX (2048 - sizeof(struct slab_obj)) // largest request served from a slab
+#define SLAB_NOBJ(cls) (PGSIZE / slab_size[cls])
+
+struct slab_class {
+  struct slab *partial; // some objects free
+  struct slab *full;    // no objects free
+  struct slab *empty;   // no objects in use
+  uint nempty;
+};
+
+// Variable-size heap for the fit strategies. A chunk of
+// contiguous pages is split into blocks of any size, and every
+// block starts with a struct heap_tag. As with slabs, the tag is
+// user memory, so the real state of each block, free or handed
+// out, is in a struct hblock that lives in kernel-only pages.
+// The tag only names the hblock, and the kernel believes it
+// only if the hblock points back at the tag. The hblocks of a
+// chunk are linked in address order; these links are the
+// boundary tags, so a freed block finds its neighbours and
+// merges with the free ones in O(1). Free blocks are kept on
+// one list per arena, most recently freed first, and the
+// arena's strategy decides which of them a request gets. A
+// chunk that is one free block again goes back to the buddy
+// allocator, unless it is the arena's last one.
+//
+// Each free block is also on the list of its size bin, so best
+// and worst fit don't have to look at every free block: a bin
+// below 512 bytes holds one size only and its first block is
+// the best fit, and a bigger bin spans a quarter of a power of
+// two. A bitmap of the bins that aren't empty finds the next
+// one up.
+#define HEAP_CHUNK_ORDER 2                        // chunks are 4 pages
+#define HEAP_CHUNK ((uint)PGSIZE << HEAP_CHUNK_ORDER)
+#define HEAP_MIN 32                               // smallest leftover worth splitting off
+#define HEAP_EXACT 64                             // bins of one size: 0, 8, ..., 504 bytes
+#define NHEAPBIN (HEAP_EXACT + 6 * 4)             // then four per power of two up to HEAP_CHUNK
+
+struct heap_tag {
+  uint desc;   // page and slot of the block's hblock, see HDESC()
+  uint magic;  // Magic number (16)
+};
+
+struct hblock {
+  char *addr;           // the block, tag included
+  uint size;            // bytes, tag included
+  uint req;             // User's requested size, 0 while free
+  struct hblock *next;  // arena's free list, or unused descriptors
+  struct hblock *prev;
+  struct hblock *anext; // the blocks right after and before this one
+  struct hblock *aprev; // in its chunk, 0 at the ends
+  struct hblock *bnext; // free blocks in the same size bin
+  struct hblock *bprev;
+  int bin;              // the size bin it is listed in, while free
+};
+
+#define HSLOTS (PGSIZE / sizeof(struct hblock)) // hblocks per descriptor page
+#define HDESC(i) ((struct hblock*)(PG2PA((i) >> 7) + ((i) & 127) * sizeof(struct hblock)))
+#define HINDEX(d) (PA2PG(d) << 7 | ((uint64)(d) % PGSIZE) / sizeof(struct hblock))
+
+// Each process allocates from its own arena, with its own
+// lock, so processes don't contend with each other. An arena
+// owns every page it has taken, handed out or not: the first
+// page of each block, slab, free page or descriptor page is
+// on its owned list. When the process exits the whole list is
+// spliced onto student_mem.reclaim in O(1), without looking
+// at a single block, and the pages go back to kmem later in
+// bulk (see student_exit and student_reclaim).
+struct arena {
   struct spinlock lock;
-  struct block_header* freelist;
+  struct block_header* freelist; // free pages, not mapped
+  struct slab* free_slabs;       // unused slab descriptors
+  struct slab_class slabs[NSLABCLASS];
+  struct block_header* owned;    // every piece this arena holds
+  struct block_header* owned_tail;
+  struct hblock* heap;           // free heap blocks, in address order
+  struct hblock* rover;          // where the next next-fit search starts
+  struct hblock* free_hblocks;   // unused heap descriptors
+  struct hblock* bins[NHEAPBIN]; // free heap blocks by size, see heap_bin()
+  uint64 binmap[2];              // bit b set while bins[b] isn't empty
+  int strategy;                  // STRATEGY_*
+  uint gen;        // bumped at exit, stale descriptor pages keep the old one
   uint num_allocated;
   uint total_allocated;
+  uint num_free;   // free pages plus cached empty slabs
+  uint num_empty;  // cached empty slabs, over all classes
+  uint num_heap;   // free heap blocks
+  uint nchunk;     // heap chunks
+  uint npages;     // pages on the owned list, blocks counted in full
+  uint64 reserved; // bytes set aside for live blocks, rounding included
+};
+
+struct arena student_arenas[NPROC]; // indexed like proc[]
+
+struct { // Student memory allocator state
+  struct spinlock lock;
+  struct block_header* freelist; // FREE_LIST_SIZE pages set aside at init, owned by no arena
+  struct block_header* reclaim;  // exited arenas' pieces, on their way back to kmem
+  struct block_header* reclaim_tail;
   uint num_free;
+  // Sums over all arenas, kept with atomics by whoever holds
+  // the arena's lock, so student_memstats() needs no locks
+  uint num_allocated;
+  uint total_allocated;
+  uint arena_free;  // the arenas' num_free plus num_heap
+  uint arena_pages; // the arenas' npages
+  uint64 reserved; // sum of the arenas' reserved
+  uint64 peak;     // highest reserved seen
+  uint64 nalloc;   // blocks handed out since boot
+  uint64 nfree;    // blocks freed since boot
+  uint64 nsuper;   // megapage mappings made, kept with atomics
   int initialized;
 } student_mem;
 
+extern struct proc proc[NPROC];
+
 void
 kinit()
 {
+  uint64 p;
+
   initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
+  initlock(&kzero.lock, "kzero");
+  initlock(&kref.lock, "kref");
+  initlock(&shm.lock, "shm");
+
+  // the per-page tables go right after the kernel; only the
+  // entries of the pages below them are cleared here, the rest
+  // as buddy_grow() reaches their pages
+  phystop = dtb_memtop(dtb);
+  p = PGROUNDUP((uint64)end);
+  kmem.info = (uchar*)p;
+  kref.count = (uchar*)(p + NPAGES);
+  student_pages = (struct block_header*)PGROUNDUP(p + 2 * NPAGES);
+  statpage = (struct memstats_page*)PGROUNDUP((uint64)(student_pages + NPAGES));
+  memset(statpage, 0, PGSIZE);
+  pginfo_clear(0, PA2PG(statpage) + 1);
+  freerange((char*)statpage + PGSIZE, (void*)phystop);
+  student_init(); // before other CPUs start, so no lock needed
+}
+
+// Clear the per-page table entries of pages [lo, hi).
+static void
+pginfo_clear(uint64 lo, uint64 hi)
+{
+  memset(&kmem.info[lo], 0, hi - lo);
+  memset(&kref.count[lo], 0, hi - lo);
+  memset(&student_pages[lo], 0, (hi - lo) * sizeof(struct block_header));
+}
+
+// Read the big-endian n-cell number at p.
+static uint64
+fdt_cells(uchar *p, int n)
+{
+  uint64 v = 0;
+
+  for(int i = 0; i < 4 * n; i++)
+    v = v << 8 | p[i];
+  return v;
+}
+
+// Find the end of the RAM that holds the kernel in the flattened
+// device tree at dtb: the "reg" of a /memory node whose range
+// covers KERNBASE. Returns PHYSTOP if there is no tree or no such
+// node, and never more than the student window can map.
+static uint64
+dtb_memtop(uint64 dtb)
+{
+  uchar *p, *val;
+  char *strs, *name;
+  uint64 base, size, top = PHYSTOP;
+  int depth = 0, mem = 0, acells = 2, scells = 2, len, i;
+
+  if(dtb == 0 || fdt_cells((uchar*)dtb, 1) != FDT_MAGIC)
+    return PHYSTOP;
+  p = (uchar*)dtb + fdt_cells((uchar*)dtb + 8, 1);
+  strs = (char*)dtb + fdt_cells((uchar*)dtb + 12, 1);
+
+  for(;;){
+    p += 4;
+    switch(fdt_cells(p - 4, 1)){
+    case FDT_BEGIN_NODE:
+      name = (char*)p;
+      depth++;
+      if(depth == 2 && strncmp(name, "memory", 6) == 0 && (name[6] == 0 || name[6] == '@'))
+        mem = depth;
+      p += (strlen(name) + 4) & ~3;
+      break;
+    case FDT_END_NODE:
+      if(mem == depth)
+        mem = 0;
+      depth--;
+      break;
+    case FDT_PROP:
+      len = fdt_cells(p, 1);
+      name = strs + fdt_cells(p + 4, 1);
+      val = p + 8;
+      p += 8 + ((len + 3) & ~3);
+      if(depth == 1 && strncmp(name, "#address-cells", 15) == 0)
+        acells = fdt_cells(val, 1);
+      else if(depth == 1 && strncmp(name, "#size-cells", 12) == 0)
+        scells = fdt_cells(val, 1);
+      else if(mem == depth && strncmp(name, "reg", 4) == 0){
+        for(i = 0; i + 4 * (acells + scells) <= len; i += 4 * (acells + scells)){
+          base = fdt_cells(val + i, acells);
+          size = fdt_cells(val + i + 4 * acells, scells);
+          if(base <= KERNBASE && KERNBASE < base + size)
+            top = base + size;
+        }
+      }
+      break;
+    case FDT_NOP:
+      break;
+    default: // FDT_END, or not a tree we understand
+      goto done;
+    }
+  }
+
+ done:
+  top = PGROUNDDOWN(top);
+  if(top > KERNBASE + USTUDENT_SIZE)
+    top = KERNBASE + USTUDENT_SIZE; // all of RAM must fit the student window
+  if(top <= (uint64)end)
+    top = PHYSTOP;
+  return top;
 }
 
+// Give [pa_start, pa_end) to kmem. Nothing in the range is
+// written yet: its pages are just counted as free, and
+// buddy_grow() moves them onto the free lists a block at a time
+// as buddy_alloc() runs out, so boot takes the same time however
+// much memory the machine has.
 void
 freerange(void *pa_start, void *pa_end)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  kmem.top = PGROUNDUP((uint64)pa_start);
+  kmem.limit = PGROUNDDOWN((uint64)pa_end);
+  if(kmem.limit < kmem.top)
+    kmem.limit = kmem.top;
+  kmem.npages += (kmem.limit - kmem.top) / PGSIZE;
+  kmem.nfree += (kmem.limit - kmem.top) / PGSIZE;
+}
+
+static void
+buddy_push(int k, struct run *r)
+{
+  r->prev = 0;
+  r->next = kmem.free[k];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[k] = r;
+  kmem.info[PA2PG(r)] = BUDDY_FREE | k;
+}
+
+static void
+buddy_unlink(int k, struct run *r)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[k] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.info[PA2PG(r)] = 0;
+}
+
+// Put the next untouched block at kmem.top on the free lists,
+// the largest aligned one that fits below kmem.limit, and clear
+// its pages' entries in the per-page tables. Its pages are
+// already counted in kmem.nfree.
+// Returns 0 if there is no memory left above kmem.top.
+// Caller holds kmem.lock.
+static int
+buddy_grow(void)
+{
+  uint64 p = kmem.top;
+  int k;
+
+  if(p + PGSIZE > kmem.limit)
+    return 0;
+  for(k = MAXORDER; k > 0; k--)
+    if((PA2PG(p) & ((1L << k) - 1)) == 0 && p + ((uint64)PGSIZE << k) <= kmem.limit)
+      break;
+  kmem.top = p + ((uint64)PGSIZE << k);
+  pginfo_clear(PA2PG(p), PA2PG(kmem.top));
+  buddy_push(k, (struct run*)p);
+  return 1;
+}
+
+// Take a block of 2^order pages, splitting a bigger
+// block if there is no free one of that order.
+// Caller holds kmem.lock.
+static struct run*
+buddy_alloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(;;){
+    for(k = order; k <= MAXORDER && kmem.free[k] == 0; k++)
+      ;
+    if(k <= MAXORDER)
+      break;
+    if(buddy_grow() == 0)
+      return 0;
+  }
+  r = kmem.free[k];
+  buddy_unlink(k, r);
+  kmem.nfree -= 1 << order;
+  while(k > order){ // put the upper halves back
+    k--;
+    buddy_push(k, (struct run*)((char*)r + ((uint64)PGSIZE << k)));
+  }
+  return r;
+}
+
+// Free a block of 2^order pages, merging it with its
+// buddy for as long as the buddy is free as well.
+// Caller holds kmem.lock.
+static void
+buddy_free(struct run *r, int order)
+{
+  uint64 pg = PA2PG(r), b;
+
+  kmem.nfree += 1 << order;
+  while(order < MAXORDER){
+    b = pg ^ (1L << order);
+    if(PG2PA(b) >= kmem.top || kmem.info[b] != (BUDDY_FREE | order))
+      break;
+    buddy_unlink(order, (struct run*)PG2PA(b));
+    pg &= ~(1L << order);
+    order++;
+  }
+  buddy_push(order, (struct run*)PG2PA(pg));
+}
+
+// Move up to n pages from the buddy allocator into cache c.
+// Caller holds c->lock.
+static void
+kcache_refill(struct kcache *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = buddy_alloc(0)) != 0){
+    r->next = c->freelist;
+    c->freelist = r;
+    c->nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Take up to n pages off this CPU's cache, refilling it from the
+// buddy allocator once if it is short, under one hold of its lock.
+// The pages are chained through run.next in *chain.
+// Returns how many were taken, fewer than n only if kmem is low.
+static int
+kcache_grab(struct run **chain, int n)
+{
+  struct kcache *c;
+  struct run *r;
+  int got = 0;
+
+  *chain = 0;
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  if(c->nfree < n)
+    kcache_refill(c, n - c->nfree + KCACHE_BATCH);
+  while(got < n && (r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->nfree--;
+    r->next = *chain;
+    *chain = r;
+    got++;
+  }
+  release(&c->lock);
+  pop_off();
+  return got;
+}
+
+// Give a chain of cached pages back to the buddy allocator.
+static void
+kcache_release(struct run *r)
+{
+  struct run *next;
+
+  acquire(&kmem.lock);
+  for(; r; r = next){
+    next = r->next;
+    buddy_free(r, 0);
+  }
+  release(&kmem.lock);
+}
+
+// Move KCACHE_BATCH pages from cache c back to the buddy allocator.
+// Caller holds c->lock.
+static void
+kcache_drain(struct kcache *c)
+{
+  struct run *head, *tail;
+  int n;
+
+  head = tail = c->freelist;
+  for(n = 1; n < KCACHE_BATCH && tail->next; n++)
+    tail = tail->next;
+  c->freelist = tail->next;
+  c->nfree -= n;
+  tail->next = 0;
+  kcache_release(head);
+}
+
+// Empty every CPU's cache into the buddy allocator, so the
+// cached single pages can merge back into larger blocks.
+static void
+kcache_flush(void)
+{
+  struct run *r;
+
+  for(int i = 0; i < NCPU; i++){
+    struct kcache *c = &kcache[i];
+    acquire(&c->lock);
+    r = c->freelist;
+    c->freelist = 0;
+    c->nfree = 0;
+    release(&c->lock);
+    kcache_release(r);
+  }
+}
+
+// Both the local cache and kmem are empty: take half of
+// some other CPU's cache. Called with no kcache lock held,
+// so two CPUs stealing from each other cannot deadlock.
+// Returns one page; any extra stolen pages go into the
+// cache of CPU id.
+static struct run*
+kcache_steal(int id)
+{
+  struct run *r, *head, *tail;
+  int i, n;
+
+  for(i = 1; i < NCPU; i++){
+    struct kcache *v = &kcache[(id + i) % NCPU];
+    if(v->nfree == 0) // racy peek, rechecked under the lock
+      continue;
+    acquire(&v->lock);
+    head = tail = v->freelist;
+    if(head == 0){
+      release(&v->lock);
+      continue;
+    }
+    for(n = 1; n < (v->nfree + 1) / 2; n++)
+      tail = tail->next;
+    v->freelist = tail->next;
+    v->nfree -= n;
+    release(&v->lock);
+
+    r = head;
+    if(n > 1){
+      struct kcache *c = &kcache[id];
+      acquire(&c->lock);
+      tail->next = c->freelist;
+      c->freelist = head->next;
+      c->nfree += n - 1;
+      release(&c->lock);
+    }
+    return r;
+  }
+  return 0;
+}
+
+// Add a reference to the page at pa, which the caller holds
+// one of, for another page table that will map it.
+void
+kref_get(void *pa)
+{
+  uint64 pg = PA2PG(pa);
+
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= phystop)
+    panic("kref_get");
+  acquire(&kref.lock);
+  if(kref.count[pg] == KREF_MAX)
+    panic("kref_get: too many");
+  kref.count[pg]++;
+  release(&kref.lock);
+}
+
+// Drop one of several references to the page at pa.
+// Returns 1 if others are left, 0 if the caller had the last
+// one and should free the page.
+static int
+kref_put(void *pa)
+{
+  uint64 pg = PA2PG(pa);
+  int left;
+
+  acquire(&kref.lock);
+  left = kref.count[pg] != 0;
+  if(left)
+    kref.count[pg]--;
+  release(&kref.lock);
+  return left;
+}
+
+// The number of references to the page at pa, 1 if it isn't shared.
+int
+kref_count(void *pa)
+{
+  return kref.count[PA2PG(pa)] + 1;
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -70,19 +793,31 @@ void
 kfree(void *pa)
 {
   struct run *r;
+  struct kcache *c;
 
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= phystop)
     panic("kfree");
 
+  // A shared page is only freed by its last owner. A count of
+  // 0 can't change under us: nobody else knows about the page.
+  if(kref.count[PA2PG(pa)] != 0 && kref_put(pa))
+    return;
+
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  JUNK(pa, PGSIZE, 1);
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off(); // cpuid() is only stable with interrupts off
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  if(c->nfree > KCACHE_HIGH)
+    kcache_drain(c);
+  release(&c->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -92,187 +827,2110 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
+  uint64 t0 = r_time();
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
+  acquire(&c->lock);
+  if(c->freelist == 0)
+    kcache_refill(c, KCACHE_BATCH);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = kcache_steal(id);
+  pop_off();
+  hist_add(HIST_KALLOC_TIME, r_time() - t0);
+
+  if(r == 0 && student_reclaim(-1) + student_trim(0) > 0)
+    return kalloc(); // the student allocator was still holding on to some
+  if(r == 0)
+    return kzero_get(); // last resort: a page from the zeroed pool
+
+  JUNK((char*)r, PGSIZE, 5); // fill with junk
+  return (void*)r;
+}
+
+// Pop a page off the zeroed pool, or return 0 if it is empty.
+static void *
+kzero_get(void)
+{
+  struct run *r;
 
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.nfree--;
+  }
+  release(&kzero.lock);
   if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+    r->next = 0; // the link was the only non-zero word
   return (void*)r;
 }
 
-// Round up size to alignment boundary
-static uint
-round_up(uint size)
+// Allocate one page of physical memory filled with zeros.
+// Takes an already-cleared page when there is one, so the
+// caller doesn't pay for the memset.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
 {
-  uint align = (1 << ALIGNMENT); // 8-byte alignment, left bit shift 
-  return (size + align - 1) & ~(align - 1); //round up to nearest multiple of align
+  void *pa;
+
+  if((pa = kzero_get()) != 0)
+    return pa;
+  if((pa = kalloc()) != 0)
+    memset(pa, 0, PGSIZE);
+  return pa;
 }
 
-// Initialize custom student allocator
-void
-student_init()
+// Allocate n pages at once, for callers that need many: they
+// come off this CPU's cache under one hold of its lock, and one
+// of kmem.lock if it has to be refilled. The pages are chained
+// through their first word, *(void**)pa being the next one and
+// 0 ending the chain, in *chain.
+// Returns how many were allocated, fewer than n only if kalloc()
+// couldn't find the rest either.
+int
+kalloc_batch(void **chain, int n)
 {
-  if(student_mem.initialized)
-    return; // Already initialized
-  
-  initlock(&student_mem.lock, "student_mem"); // Initialize lock
-  student_mem.freelist = 0;
-  student_mem.num_allocated = 0;
-  student_mem.total_allocated = 0;
-  student_mem.num_free = 0;
-  
-  // Pre-allocate FREE_LIST_SIZE pages
-  for(int i = 0; i < FREE_LIST_SIZE; i++) { //20 pages
-    void* page = kalloc();
-    if(page == 0) //kalloc failed
+  struct run *r, *p;
+  int got;
+
+  got = kcache_grab(&r, n);
+  for(; got < n; got++){
+    // kmem is low, kalloc() tries harder
+    if((p = kalloc()) == 0)
       break;
-    
-    // Initialize block header
-    struct block_header* block = (struct block_header*)page;
-    block->size = 0;
-    block->magic = MAGIC_NUMBER;
-    block->allocated = 0;
-    block->next = student_mem.freelist;
-    student_mem.freelist = block;
-    student_mem.num_free++;
+    p->next = r;
+    r = p;
   }
-  
-  student_mem.initialized = 1; // Mark as initialized
+#ifdef KALLOC_DEBUG
+  for(p = r; p; p = p->next){
+    struct run *next = p->next;
+    JUNK((char*)p, PGSIZE, 5);
+    p->next = next;
+  }
+#endif
+  *chain = r;
+  return got;
 }
 
-// Allocate memory using custom allocator
-void*
-student_malloc(uint size)
+// Like kalloc_batch(), but the pages are zeroed apart from the
+// link in their first word. As many as it has come from the
+// kzero pool, under one hold of its lock; only the rest are
+// cleared here.
+static int
+kalloc_zeroed_batch(void **chain, int n)
 {
-   // 1. Initialize if first call
-  if(!student_mem.initialized)
-    student_init();
-  
-  //if allocating 0 bytes then return 0
-  if(size == 0)
-    return 0;
-  
-  uint aligned_size = round_up(size);
-  
-  //getting the lock, to avoid race conditions
-  acquire(&student_mem.lock);
-  
-  // Find best-fit block
-  struct block_header* best = 0; // 0 initialy because no block selected yet
-  struct block_header* curr = student_mem.freelist; //starting at the head of the free list
-  
-  // Best-fit strategy: find smallest suitable block
-  //since all blocks are of size PGSIZE, I just need to find a free block
-  if(ALLOCATION_STRATEGY == 1) { // 1 = best-fit
-    while(curr) { //traverse the free list
-      if(!curr->allocated) { //if block is free
-        uint available = PGSIZE - sizeof(struct block_header); //available space in block
-        //   block is big enough , which is always true since all blocks are same size
-        if(aligned_size <= available ) {
-          best = curr; //update best
-          break; //found suitable block, done
-        }
-      }
-      curr = curr->next;
-    }
+  struct run *r, *next, *more, *head = 0;
+  int got = 0;
+
+  acquire(&kzero.lock);
+  for(; got < n && (r = kzero.freelist) != 0; got++){
+    kzero.freelist = r->next;
+    kzero.nfree--;
+    r->next = head;
+    head = r;
   }
-  
-  // If no suitable block found, allocate new page
-  if(best == 0) {
-    void* page = kalloc(); //get new page
-    if(page == 0) { //kalloc failed
-      release(&student_mem.lock);
-      return 0;
+  release(&kzero.lock);
+  if(got < n){
+    got += kalloc_batch((void**)&more, n - got);
+    for(r = more; r; r = next){
+      next = r->next;
+      memset(r, 0, PGSIZE);
+      r->next = head;
+      head = r;
     }
-    
-    best = (struct block_header*)page; //set best to new page
-    best->magic = MAGIC_NUMBER;
-    best->allocated = 0; //mark as free
-    best->next = student_mem.freelist; // i decided to add new block at head of free list, 
-    student_mem.freelist = best; ////becuase it is O(1) at the head, update head to new block
   }
-  
-  // Now mark block as allocated
-  best->size = size;
-  best->allocated = 1;
-  student_mem.num_allocated++;
-  student_mem.total_allocated += size; // track total mem allocated size
-  
-  // Update free count
-  student_mem.num_free = 0;  // Reset counter to 0, will recount below, how many free blocks there are
-  curr = student_mem.freelist; //starting at head of free list
-  while(curr) {
-    if(!curr->allocated)
-      student_mem.num_free++; 
-    curr = curr->next;
+  *chain = head;
+  return got;
+}
+
+// Free a chain of pages linked as kalloc_batch() hands them out.
+// They go onto this CPU's cache under one hold of its lock, or,
+// if there are more than the cache should keep, straight back to
+// the buddy allocator under one hold of kmem.lock.
+void
+kfree_batch(void *chain)
+{
+  struct run *r, *next, *head = 0, *tail = 0;
+  struct kcache *c;
+  int n = 0;
+
+  for(r = chain; r; r = next){
+    next = r->next;
+    if(((uint64)r % PGSIZE) != 0 || (char*)r < end || (uint64)r >= phystop)
+      panic("kfree_batch");
+    if(kref.count[PA2PG(r)] != 0 && kref_put(r))
+      continue;
+    JUNK((char*)r, PGSIZE, 1);
+    r->next = head;
+    head = r;
+    if(tail == 0)
+      tail = r;
+    n++;
+  }
+  if(head == 0)
+    return;
+  if(n > KCACHE_HIGH){
+    kcache_release(head);
+    return;
   }
-  
-  release(&student_mem.lock); // Unlock (done modifying)
 
-  //at first i though to return 
-  //return (void*)best;  
-  // but this does not work because it returns pointer to header, not to user data
-  
-  // Return pointer after header
-  return (void*)((char*)best + sizeof(struct block_header));
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  tail->next = c->freelist;
+  c->freelist = head;
+  c->nfree += n;
+  if(c->nfree > KCACHE_HIGH)
+    kcache_drain(c);
+  release(&c->lock);
+  pop_off();
 }
 
-// Free memory allocated by student_malloc
-void
-student_free(void* ptr)
+// Handle a page fault at va on memory that process p grew with
+// sbrklazy(): map the page, and after it up to a window of pages
+// that are below p->sz and not mapped yet, zeroed, from one
+// kalloc_zeroed_batch(). Called by vmfault().
+// Returns the physical address of va's page, or 0 if va is not
+// in p's memory, is already mapped, or there is no memory.
+uint64
+fault_around(struct proc *p, uint64 va)
 {
-  if(ptr == 0)
-    return; //nothing to free
-  
-  if(!student_mem.initialized)
-    return; // Allocator not initialized, nothing to free
-  
-  // Get block header
-  struct block_header* block = (struct block_header*)((char*)ptr - sizeof(struct block_header));
-  
-  acquire(&student_mem.lock); // Lock for thread safety
-  
-  // Verify magic number
-  if(block->magic != MAGIC_NUMBER) {
-    release(&student_mem.lock);
-    panic("student_free: bad magic number");
+  struct faultaround *f = &lazy.proc[p - proc];
+  struct run *chain, *r;
+  uint64 a, pa = 0;
+  int n;
+
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz || ismapped(p->pagetable, va))
+    return 0;
+
+  if(f->pid == p->pid && va == f->next){
+    if((f->window *= 2) > FAULT_AROUND_MAX)
+      f->window = FAULT_AROUND_MAX;
+  } else {
+    f->pid = p->pid;
+    f->window = FAULT_AROUND_MIN < FAULT_AROUND_MAX ? FAULT_AROUND_MIN : FAULT_AROUND_MAX;
   }
-  
-  if(!block->allocated) { // prevent Double freeing becuase that would be pointless
-    release(&student_mem.lock);
-    panic("student_free: double free");
+
+  // stop at the end of p's memory or a page that's already there
+  for(n = 1; n < f->window; n++)
+    if(va + (uint64)n * PGSIZE >= p->sz || ismapped(p->pagetable, va + (uint64)n * PGSIZE))
+      break;
+
+  if(kalloc_zeroed_batch((void**)&chain, n) == 0)
+    return 0;
+
+  for(a = va; (r = chain) != 0; a += PGSIZE){
+    chain = r->next;
+    r->next = 0;
+    if(mappages(p->pagetable, a, PGSIZE, (uint64)r, PTE_W | PTE_U | PTE_R) != 0){
+      r->next = chain;
+      kfree_batch(r);
+      break;
+    }
+    if(a == va)
+      pa = (uint64)r;
   }
-  
-  // Mark as free
-  student_mem.total_allocated -= block->size; // Update total allocated size
-  student_mem.num_allocated--; // Decrement allocated count
-  block->allocated = 0;
-  block->size = 0;
-  student_mem.num_free++; // Increment free count
-  
-  release(&student_mem.lock);
+  f->next = a;
+  __sync_fetch_and_add(&lazy.nfault, 1);
+  __sync_fetch_and_add(&lazy.npages, (a - va) / PGSIZE);
+  return pa;
 }
 
+// Give the child page table new the parent's memory [0, sz)
+// copy-on-write, for fork(). Instead of being copied, each page
+// is mapped in both, and writable pages are made read-only with
+// PTE_COW set in both; cow_fault() copies a page when one of
+// them writes it. A megapage is shared the same way, with its
+// reference count on its first page. Pages that sbrklazy()
+// hasn't faulted in are skipped.
+// Returns 0 on success, -1 on failure, with new's mappings of
+// the range freed.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  pte_t *pte;
+  uint64 pa, i;
+  int level, flags;
 
-// Get detailed memory statistics for system call
-// decided to modify the signature as i see fit for student stats
+  for(i = 0; i < sz; i += level ? SUPERPGSIZE : PGSIZE){
+    level = 0;
+    if((pte = leaf_pte(old, i, &level)) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    flags = PTE_FLAGS(*pte);
+    if(flags & (PTE_W | PTE_COW)){
+      flags = (flags & ~PTE_W) | PTE_COW;
+      *pte = PA2PTE(pa) | flags;
+    }
+    if(level){
+      if(map_super(new, i, (char*)pa, flags & ~PTE_V) != 0)
+        goto err;
+    } else if(mappages(new, i, PGSIZE, pa, flags & ~PTE_V) != 0){
+      goto err;
+    }
+    kref_get((void*)pa);
+  }
+  sfence_vma(); // the parent's TLB may still allow writes
+  return 0;
+
+ err:
+  sfence_vma();
+  unshare(new, i);
+  return -1;
+}
+
+// Undo a uvmshare() that got as far as va: unmap new's pages
+// below va, dropping the references they held.
+static void
+unshare(pagetable_t new, uint64 va)
+{
+  pte_t *pte;
+  uint64 i;
+  int level;
+
+  for(i = 0; i < va; i += level ? SUPERPGSIZE : PGSIZE){
+    level = 0;
+    if((pte = leaf_pte(new, i, &level)) == 0)
+      continue;
+    if(level)
+      kfree_super((void*)PTE2PA(*pte));
+    else
+      kfree((void*)PTE2PA(*pte));
+    *pte = 0;
+  }
+}
+
+// Handle a write to va, which may be a page shared copy-on-write.
+// The last owner gets the page (or megapage) as it is, made writable; any
+// other gets a copy. vm.c's copyout() calls this before writing
+// to a user page, and usertrap() on a store page fault.
+// Returns 1 if it was such a page and is now writable, 0 if va
+// isn't a copy-on-write page, or -1 if there is no memory.
+int
+cow_fault(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+  int level;
+
+  if(va >= MAXVA)
+    return 0;
+  if((pte = leaf_pte(pagetable, va, &level)) == 0 ||
+     (*pte & PTE_COW) == 0 || (*pte & PTE_U) == 0)
+    return 0;
+
+  pa = PTE2PA(*pte);
+  if(kref_count((void*)pa) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+  } else {
+    if((mem = level ? kalloc_super() : kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, level ? SUPERPGSIZE : PGSIZE);
+    *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+    if(level)
+      kfree_super((void*)pa);
+    else
+      kfree((void*)pa);
+  }
+  sfence_vma();
+  return 1;
+}
+
+// Find the shared memory segment with key, which must be at
+// least size bytes, or make a zeroed one of size bytes if there
+// is none, and have process p hold it until shm_detach() or exit.
+// Returns the segment's id, or -1 if key or size is bad, the
+// existing segment is too small, or there is no memory or slot.
+int
+shm_get(struct proc *p, int key, int size)
+{
+  struct shmseg *s, *slot;
+  void *chain = 0;
+  int id, i, n;
+
+  if(key <= 0 || size < 0 || size > SHM_MAXSIZE)
+    return -1;
+  n = PGROUNDUP((uint64)size) / PGSIZE;
+
+  acquire(&shm.lock);
+  for(;;){
+    slot = 0;
+    for(id = 0; id < NSHM; id++){
+      s = &shm.seg[id];
+      if(s->key == key)
+        break;
+      if(s->key == 0 && slot == 0)
+        slot = s;
+    }
+    if(id < NSHM || chain)
+      break;
+    if(slot == 0 || n == 0)
+      goto err;
+    // the pages are found and zeroed without shm.lock, so look
+    // again after: someone may have made the segment meanwhile
+    release(&shm.lock);
+    if(kalloc_zeroed_batch(&chain, n) < n){
+      kfree_batch(chain);
+      return -1;
+    }
+    acquire(&shm.lock);
+  }
+  if(id == NSHM){
+    if(slot == 0)
+      goto err;
+    s = slot;
+    for(i = 0; i < n; i++){
+      s->pages[i] = chain;
+      chain = *(void**)chain;
+      *(void**)s->pages[i] = 0;
+    }
+    s->key = key;
+    s->npages = n;
+    s->nheld = 0;
+    id = s - shm.seg;
+  } else if(n > s->npages){
+    goto err;
+  }
+  if((shm.held[p - proc] & (1 << id)) == 0){
+    shm.held[p - proc] |= 1 << id;
+    s->nheld++;
+  }
+  release(&shm.lock);
+  kfree_batch(chain); // not needed after all
+  return id;
+
+ err:
+  release(&shm.lock);
+  kfree_batch(chain);
+  return -1;
+}
+
+// Map segment id, which p holds, into p's page table, if it
+// isn't already. Returns its user address, or 0 if p doesn't
+// hold it or a page-table page can't be allocated.
+uint64
+shm_attach(struct proc *p, int id)
+{
+  struct shmseg *s;
+  uint64 va;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return 0;
+  s = &shm.seg[id];
+  va = USHM + id * SHM_MAXSIZE;
+
+  acquire(&shm.lock);
+  if((shm.held[p - proc] & (1 << id)) == 0){
+    release(&shm.lock);
+    return 0;
+  }
+  if((shm.mapped[p - proc] & (1 << id)) == 0){
+    for(i = 0; i < s->npages; i++){
+      if(mappages(p->pagetable, va + i * PGSIZE, PGSIZE, (uint64)s->pages[i], PTE_R | PTE_W | PTE_U) != 0){
+        uvmunmap(p->pagetable, va, i, 1);
+        release(&shm.lock);
+        return 0;
+      }
+      kref_get(s->pages[i]);
+    }
+    shm.mapped[p - proc] |= 1 << id;
+  }
+  release(&shm.lock);
+  return va;
+}
+
+// Unmap the segment at user address va from p and stop holding it.
+// Returns -1 if va isn't the address of a segment p holds.
+int
+shm_detach(struct proc *p, uint64 va)
+{
+  int id;
+
+  if(va < USHM || va >= USHM_TOP || (va - USHM) % SHM_MAXSIZE != 0)
+    return -1;
+  id = (va - USHM) / SHM_MAXSIZE;
+
+  acquire(&shm.lock);
+  if((shm.held[p - proc] & (1 << id)) == 0){
+    release(&shm.lock);
+    return -1;
+  }
+  shm_release(p, id);
+  release(&shm.lock);
+  return 0;
+}
+
+// p lets go of segment id: unmap it if p attached it, and free
+// the segment if p was its last holder. Pages some other page
+// table still maps stay until it unmaps them.
+// Caller holds shm.lock.
+static void
+shm_release(struct proc *p, int id)
+{
+  struct shmseg *s = &shm.seg[id];
+  int i;
+
+  if(shm.mapped[p - proc] & (1 << id)){
+    uvmunmap(p->pagetable, USHM + id * SHM_MAXSIZE, s->npages, 1);
+    shm.mapped[p - proc] &= ~(1 << id);
+  }
+  shm.held[p - proc] &= ~(1 << id);
+  if(--s->nheld == 0){
+    for(i = 0; i < s->npages; i++)
+      *(void**)s->pages[i] = i + 1 < s->npages ? s->pages[i + 1] : 0;
+    kfree_batch(s->pages[0]);
+    s->key = 0;
+    s->npages = 0;
+  }
+}
+
+// Called by a CPU that has nothing to run: give back some of
+// the pages exited processes left in the student allocator,
+// then clear a few free pages and park them in kzero, until
+// it holds KZERO_TARGET.
+// Does a bounded amount of work so the CPU notices new
+// runnable processes quickly.
 void
-student_get_stats(uint* magic, uint* strategy, uint* num_alloc, uint* total_alloc, uint* num_free)
+kzero_idle(void)
 {
-  if(!student_mem.initialized) // Initialize if not done yet
-    student_init();
-  
+  struct run *chain, *r, *next, *tail = 0;
+  int n;
+
+  student_reclaim(KCACHE_BATCH);
+
+  if(kzero.nfree >= KZERO_TARGET) // racy peek, a few extra pages don't hurt
+    return;
+  if((n = kalloc_batch((void**)&chain, KZERO_BATCH)) == 0)
+    return;
+  for(r = chain; r; r = next){
+    next = r->next;
+    memset(r, 0, PGSIZE);
+    r->next = next; // the link is the only non-zero word
+    tail = r;
+  }
+  acquire(&kzero.lock);
+  tail->next = kzero.freelist;
+  kzero.freelist = chain;
+  kzero.nfree += n;
+  release(&kzero.lock);
+}
+
+// Allocate 2^order physically contiguous pages.
+// Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_pages(int order)
+{
+  struct run *r;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order > MAXORDER)
+    return 0;
+
+  acquire(&kmem.lock);
+  r = buddy_alloc(order);
+  release(&kmem.lock);
+  if(r == 0){
+    // the pieces may be sitting in the per-CPU caches,
+    // or not have come back from exited processes yet
+    student_reclaim(-1);
+    student_trim(0);
+    kcache_flush();
+    acquire(&kmem.lock);
+    r = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+
+  if(r)
+    JUNK((char*)r, (uint64)PGSIZE << order, 5); // fill with junk
+  return (void*)r;
+}
+
+// Allocate 2 MB of physically contiguous memory, aligned to
+// 2 MB, to back a megapage (a leaf PTE at level 1).
+// Returns 0 if there is no such block; the caller should then
+// fall back to 4096-byte pages.
+void *
+kalloc_super(void)
+{
+  return kalloc_pages(SUPERORDER);
+}
+
+// Free a block from kalloc_super().
+void
+kfree_super(void *pa)
+{
+  kfree_pages(pa, SUPERORDER);
+}
+
+// Make sure va isn't in the middle of a megapage, so that
+// uvmdealloc() can unmap from va on: a megapage across va is
+// split into 512 leaves of 4096 bytes in a new page-table page,
+// whose pages can then be freed one by one. A megapage that is
+// still shared copy-on-write is copied first, as its reference
+// count covers the whole block.
+// Returns 0, or -1 if there is no memory, and then nothing has
+// changed.
+int
+super_split(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  pagetable_t l0;
+  uint64 pa;
+  char *mem;
+  int level, flags, i;
+
+  if(va % SUPERPGSIZE == 0 || va >= MAXVA ||
+     (pte = leaf_pte(pagetable, va, &level)) == 0 || level != 1)
+    return 0;
+  pa = PTE2PA(*pte);
+  flags = PTE_FLAGS(*pte);
+  if((l0 = kalloc_zeroed()) == 0)
+    return -1;
+  if(kref_count((void*)pa) > 1){
+    if((mem = kalloc_super()) == 0){
+      kfree(l0);
+      return -1;
+    }
+    memmove(mem, (char*)pa, SUPERPGSIZE);
+    kfree_super((void*)pa);
+    pa = (uint64)mem;
+    if(flags & PTE_COW)
+      flags = (flags | PTE_W) & ~PTE_COW;
+  }
+  for(i = 0; i < 512; i++)
+    l0[i] = PA2PTE(pa + (uint64)i * PGSIZE) | flags;
+  *pte = PA2PTE(l0) | PTE_V;
+  sfence_vma();
+  return 0;
+}
+
+// Free 2^order contiguous pages at pa, which must have
+// come from kalloc_pages(order), or be part of such a
+// block and aligned to its own size.
+void
+kfree_pages(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+
+  if(order < 0 || order > MAXORDER || ((uint64)pa % PGSIZE) != 0 ||
+     (PA2PG(pa) & ((1L << order) - 1)) != 0 ||
+     (char*)pa < end || (uint64)pa + ((uint64)PGSIZE << order) > phystop)
+    panic("kfree_pages");
+
+  // A megapage shared copy-on-write is counted on its first page.
+  if(kref.count[PA2PG(pa)] != 0 && kref_put(pa))
+    return;
+
+  // Fill with junk to catch dangling refs.
+  JUNK(pa, (uint64)PGSIZE << order, 1);
+
+  acquire(&kmem.lock);
+  buddy_free((struct run*)pa, order);
+  release(&kmem.lock);
+}
+
+// Round up size to alignment boundary
+static uint
+round_up(uint size)
+{
+  uint align = (1 << ALIGNMENT); // 8-byte alignment, left bit shift 
+  return (size + align - 1) & ~(align - 1); //round up to nearest multiple of align
+}
+
+// Add a piece to arena a's owned list. Caller holds a->lock.
+static void
+owned_add(struct arena *a, struct block_header *b)
+{
+  b->oprev = 0;
+  b->onext = a->owned;
+  if(a->owned)
+    a->owned->oprev = b;
+  else
+    a->owned_tail = b;
+  a->owned = b;
+  a->npages += b->npages;
+  __sync_fetch_and_add(&student_mem.arena_pages, b->npages);
+}
+
+// Take a piece off arena a's owned list. Caller holds a->lock.
+static void
+owned_del(struct arena *a, struct block_header *b)
+{
+  if(b->oprev)
+    b->oprev->onext = b->onext;
+  else
+    a->owned = b->onext;
+  if(b->onext)
+    b->onext->oprev = b->oprev;
+  else
+    a->owned_tail = b->oprev;
+  a->npages -= b->npages;
+  __sync_fetch_and_sub(&student_mem.arena_pages, b->npages);
+}
+
+// A block for a size-byte request, n bytes with rounding, was
+// handed out (n > 0) or freed (n < 0) by arena a: update its
+// counters and the global ones, reserved bytes and peak
+// included. Caller holds a->lock.
+static void
+account(struct arena *a, uint size, long n)
+{
+  uint64 now, peak;
+
+  a->reserved += n;
+  if(n < 0) {
+    a->num_allocated--;
+    a->total_allocated -= size;
+    __sync_fetch_and_sub(&student_mem.num_allocated, 1);
+    __sync_fetch_and_sub(&student_mem.total_allocated, size);
+    __sync_fetch_and_add(&student_mem.nfree, 1);
+    __sync_fetch_and_sub(&student_mem.reserved, -n);
+    return;
+  }
+  a->num_allocated++;
+  a->total_allocated += size;
+  __sync_fetch_and_add(&student_mem.num_allocated, 1);
+  __sync_fetch_and_add(&student_mem.total_allocated, size);
+  __sync_fetch_and_add(&student_mem.nalloc, 1);
+  now = __sync_add_and_fetch(&student_mem.reserved, n);
+  while(now > (peak = student_mem.peak) &&
+        !__sync_bool_compare_and_swap(&student_mem.peak, peak, now))
+    ;
+}
+
+// Take a page off the arena's free list, else out of the
+// student_mem reserve, else get a fresh one from kalloc().
+// A page from outside the arena may hold another process's or
+// the kernel's data, and is zeroed before this process can map it.
+// The caller sets its kind. Caller holds a->lock.
+static void*
+pool_get(struct arena *a)
+{
+  struct block_header *b;
+  char *page;
+
+  if((b = a->freelist) != 0) {
+    a->freelist = b->next;
+    a->num_free--;
+    __sync_fetch_and_sub(&student_mem.arena_free, 1);
+    return HDRPAGE(b);
+  }
+
+  acquire(&student_mem.lock);
+  if((b = student_mem.freelist) != 0) {
+    student_mem.freelist = b->next;
+    student_mem.num_free--;
+  }
+  release(&student_mem.lock);
+  if(b) {
+    page = HDRPAGE(b);
+    memset(page, 0, PGSIZE);
+  } else if((page = kalloc_zeroed()) == 0) {
+    return 0;
+  }
+  b = PGHDR(page);
+  b->npages = 1;
+  owned_add(a, b);
+  return page;
+}
+
+// Put a page back on the arena's free list. An arena keeps
+// up to ARENA_FREE_MAX free pages; more go to the student_mem
+// reserve, and when that passes STUDENT_HIGH_WATER it is
+// trimmed back to FREE_LIST_SIZE, so a burst of allocations
+// doesn't pin its pages after they're freed.
+// Caller holds a->lock.
+static void
+pool_put(struct arena *a, void *page)
+{
+  struct block_header *b = PGHDR(page);
+  int trim;
+
+  b->kind = BLK_FREE;
+  b->size = 0;
+  if(a->num_free - a->num_empty < ARENA_FREE_MAX) {
+    b->next = a->freelist;
+    a->freelist = b;
+    a->num_free++;
+    __sync_fetch_and_add(&student_mem.arena_free, 1);
+    return;
+  }
+
+  owned_del(a, b);
   acquire(&student_mem.lock);
+  b->next = student_mem.freelist;
+  student_mem.freelist = b;
+  student_mem.num_free++;
+  trim = student_mem.num_free > STUDENT_HIGH_WATER;
+  release(&student_mem.lock);
+  if(trim)
+    student_trim(FREE_LIST_SIZE);
+}
+
+static void
+slab_push(struct slab **list, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *list;
+  if(*list)
+    (*list)->prev = s;
+  *list = s;
+}
+
+static void
+slab_unlink(struct slab **list, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    *list = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Smallest class whose objects hold n bytes, header included.
+static int
+slab_class_of(uint n)
+{
+  int i;
+
+  for(i = 0; i < NSLABCLASS - 1; i++)
+    if(n <= slab_size[i])
+      break;
+  return i;
+}
+
+// Build a new slab of class cls with all objects free. Its
+// descriptor comes from pages that are never mapped to user space.
+// Caller holds a->lock.
+static struct slab*
+slab_new(struct arena *a, int cls)
+{
+  struct slab *s;
+  char *page;
+
+  if(a->free_slabs == 0) {
+    if((page = kalloc()) == 0)
+      return 0;
+    PGHDR(page)->kind = BLK_META;
+    PGHDR(page)->npages = 1;
+    owned_add(a, PGHDR(page));
+    for(s = (struct slab*)page; (char*)(s + 1) <= page + PGSIZE; s++) {
+      s->next = a->free_slabs;
+      a->free_slabs = s;
+    }
+  }
+  if((page = pool_get(a)) == 0)
+    return 0;
+  s = a->free_slabs;
+  a->free_slabs = s->next;
+
+  s->page = page;
+  s->cls = cls;
+  s->inuse = 0;
+  s->used[0] = s->used[1] = s->used[2] = s->used[3] = 0;
+  PGHDR(page)->kind = BLK_SLAB;
+  PGHDR(page)->slab = s;
+  return s;
+}
+
+// Index of the first free object in s, which has one.
+static int
+slab_first_free(struct slab *s)
+{
+  int w, bit;
+  uint64 x;
+
+  for(w = 0; s->used[w] == ~0UL; w++)
+    ;
+  x = ~s->used[w];
+  for(bit = 0; (x & 0xff) == 0; bit += 8)
+    x >>= 8;
+  for(; (x & 1) == 0; bit++)
+    x >>= 1;
+  return w * 64 + bit;
+}
+
+// Allocate an object for a size-byte request from a slab.
+// Caller holds a->lock.
+static void*
+slab_alloc(struct arena *a, uint size)
+{
+  int cls = slab_class_of(round_up(size) + sizeof(struct slab_obj));
+  struct slab_class *sc = &a->slabs[cls];
+  struct slab *s;
+  struct slab_obj *o;
+  int i;
+
+  if((s = sc->partial) == 0) {
+    if((s = sc->empty) != 0) { // reuse a cached empty slab first
+      slab_unlink(&sc->empty, s);
+      sc->nempty--;
+      a->num_empty--;
+      a->num_free--;
+      __sync_fetch_and_sub(&student_mem.arena_free, 1);
+    } else if((s = slab_new(a, cls)) == 0) {
+      return 0;
+    }
+    slab_push(&sc->partial, s);
+  }
+
+  i = slab_first_free(s);
+  s->used[i / 64] |= 1UL << (i % 64);
+  if(++s->inuse == SLAB_NOBJ(cls)) { // slab just became full
+    slab_unlink(&sc->partial, s);
+    slab_push(&sc->full, s);
+  }
+
+  o = (struct slab_obj*)(s->page + i * slab_size[cls]);
+  o->size = size;
+  o->magic = MAGIC_NUMBER;
+  account(a, size, slab_size[cls]);
+  return (void*)(o + 1);
+}
+
+// Free a slab object. Empty slabs are cached up to
+// SLAB_KEEP_EMPTY per class, the rest go back to the page pool.
+// Returns -1 if ptr is not an object that is handed out.
+// Caller holds a->lock.
+static int
+slab_free(struct arena *a, struct slab *s, void *ptr)
+{
+  struct slab_obj *o = (struct slab_obj*)ptr - 1;
+  struct slab_class *sc = &a->slabs[s->cls];
+  uint64 off = (char*)o - s->page;
+  uint i = off / slab_size[s->cls];
+  uint size;
+
+  // not the start of an object, or not handed out (double free)
+  if((char*)o < s->page || off % slab_size[s->cls] != 0 ||
+     (s->used[i / 64] & (1UL << (i % 64))) == 0)
+    return -1;
+  s->used[i / 64] &= ~(1UL << (i % 64));
+
+  // o->size is user memory, don't let it skew the totals further than the class size
+  size = o->size;
+  if(size > slab_size[s->cls] - sizeof(struct slab_obj))
+    size = slab_size[s->cls] - sizeof(struct slab_obj);
+  if(size > a->total_allocated)
+    size = a->total_allocated;
+  account(a, size, -(long)slab_size[s->cls]);
+
+  if(s->inuse-- == SLAB_NOBJ(s->cls)) { // was full, has room again
+    slab_unlink(&sc->full, s);
+    slab_push(&sc->partial, s);
+  }
+
+  if(s->inuse == 0) {
+    slab_unlink(&sc->partial, s);
+    if(sc->nempty < SLAB_KEEP_EMPTY) {
+      slab_push(&sc->empty, s);
+      sc->nempty++;
+      a->num_empty++;
+      a->num_free++;
+      __sync_fetch_and_add(&student_mem.arena_free, 1);
+    } else {
+      pool_put(a, s->page);
+      s->next = a->free_slabs;
+      a->free_slabs = s;
+    }
+  }
+  return 0;
+}
+
+// Free pages [lo, hi) of the buddy block at base in the
+// largest aligned pieces, so they merge back into big blocks.
+static void
+free_run(char* base, uint lo, uint hi)
+{
+  int k;
+
+  while(lo < hi) {
+    for(k = 0; k < MAXORDER && (lo & ((2U << k) - 1)) == 0 && lo + (2U << k) <= hi; k++)
+      ;
+    kfree_pages(base + (uint64)lo * PGSIZE, k);
+    lo += 1U << k;
+  }
+}
+
+// Requests that don't fit in one page get a run of contiguous
+// pages from kalloc_pages(), zeroed. The buddy block is rounded
+// up to a power of two, so the unused tail is given straight back.
+static void*
+large_alloc(struct arena *a, uint size)
+{
+  uint npages = PGROUNDUP((uint64)size) / PGSIZE;
+  struct block_header* block;
+  char* pages;
+  int order = 0;
+
+  while((1U << order) < npages)
+    order++;
+  if(order > MAXORDER || (pages = kalloc_pages(order)) == 0)
+    return 0;
+  free_run(pages, npages, 1U << order);
+  memset(pages, 0, (uint64)npages * PGSIZE);
+
+  acquire(&a->lock);
+  block = PGHDR(pages);
+  block->kind = BLK_BLOCK;
+  block->size = size;
+  block->npages = npages;
+  owned_add(a, block);
+  account(a, size, (long)npages * PGSIZE);
+  release(&a->lock);
+
+  return pages;
+}
+
+// Take an unused heap descriptor, carving a new page of them
+// if there are none. Caller holds a->lock.
+static struct hblock*
+hblock_get(struct arena *a)
+{
+  struct hblock *d;
+  char *page;
+
+  if(a->free_hblocks == 0) {
+    if((page = kalloc()) == 0)
+      return 0;
+    PGHDR(page)->size = a->gen;
+    PGHDR(page)->kind = BLK_HMETA;
+    PGHDR(page)->npages = 1;
+    PGHDR(page)->arena = a;
+    owned_add(a, PGHDR(page));
+    for(d = (struct hblock*)page; (char*)(d + 1) <= page + PGSIZE; d++) {
+      d->addr = 0;
+      d->next = a->free_hblocks;
+      a->free_hblocks = d;
+    }
+  }
+  d = a->free_hblocks;
+  a->free_hblocks = d->next;
+  return d;
+}
+
+// Return a heap descriptor to the arena's unused ones.
+// Caller holds a->lock.
+static void
+hblock_put(struct arena *a, struct hblock *d)
+{
+  d->addr = 0; // no tag can point here any more
+  d->req = 0;
+  d->next = a->free_hblocks;
+  a->free_hblocks = d;
+}
+
+// The size bin of a free block of n bytes.
+static int
+heap_bin(uint n)
+{
+  int lg;
+
+  if(n < HEAP_EXACT * 8)
+    return n / 8;
+  for(lg = 9; (2u << lg) <= n; lg++)
+    ;
+  // 2^lg <= n < 2^(lg+1): four bins 2^(lg-2) bytes apart
+  return HEAP_EXACT + (lg - 9) * 4 + ((n >> (lg - 2)) & 3);
+}
+
+// Put the free block d on the list of its size bin.
+// Caller holds a->lock.
+static void
+bin_add(struct arena *a, struct hblock *d)
+{
+  int b = heap_bin(d->size);
+
+  d->bin = b;
+  d->bprev = 0;
+  d->bnext = a->bins[b];
+  if(d->bnext)
+    d->bnext->bprev = d;
+  a->bins[b] = d;
+  a->binmap[b / 64] |= 1UL << (b % 64);
+}
+
+// Take d off the list of the size bin it is on.
+// Caller holds a->lock.
+static void
+bin_del(struct arena *a, struct hblock *d)
+{
+  if(d->bprev)
+    d->bprev->bnext = d->bnext;
+  else if((a->bins[d->bin] = d->bnext) == 0)
+    a->binmap[d->bin / 64] &= ~(1UL << (d->bin % 64));
+  if(d->bnext)
+    d->bnext->bprev = d->bprev;
+}
+
+// The first bin from b up that isn't empty, or -1.
+// Caller holds a->lock.
+static int
+bin_next(struct arena *a, int b)
+{
+  uint64 x;
+
+  for(; b < NHEAPBIN; b = (b / 64 + 1) * 64) {
+    x = a->binmap[b / 64] >> (b % 64);
+    if(x == 0)
+      continue;
+    for(; (x & 0xff) == 0; b += 8)
+      x >>= 8;
+    for(; (x & 1) == 0; b++)
+      x >>= 1;
+    return b;
+  }
+  return -1;
+}
+
+// Put the free block d at the head of the arena's heap list.
+// Caller holds a->lock.
+static void
+heap_push(struct arena *a, struct hblock *d)
+{
+  bin_add(a, d);
+  d->prev = 0;
+  d->next = a->heap;
+  if(a->heap)
+    a->heap->prev = d;
+  a->heap = d;
+  a->num_heap++;
+  __sync_fetch_and_add(&student_mem.arena_free, 1);
+}
+
+// Put the free block d in old's place on the arena's heap
+// list. Caller holds a->lock.
+static void
+heap_replace(struct arena *a, struct hblock *old, struct hblock *d)
+{
+  bin_del(a, old);
+  bin_add(a, d);
+  d->prev = old->prev;
+  d->next = old->next;
+  if(d->prev)
+    d->prev->next = d;
+  else
+    a->heap = d;
+  if(d->next)
+    d->next->prev = d;
+  if(a->rover == old)
+    a->rover = d;
+}
+
+// Take d off the arena's heap list. Caller holds a->lock.
+static void
+heap_unlink(struct arena *a, struct hblock *d)
+{
+  bin_del(a, d);
+  if(d->prev)
+    d->prev->next = d->next;
+  else
+    a->heap = d->next;
+  if(d->next)
+    d->next->prev = d->prev;
+  if(a->rover == d)
+    a->rover = d->next;
+  a->num_heap--;
+  __sync_fetch_and_sub(&student_mem.arena_free, 1);
+}
+
+// The free block that a request of n bytes, tag included, gets
+// under the arena's strategy, or 0 if none is big enough.
+// Caller holds a->lock.
+static struct hblock*
+heap_find(struct arena *a, uint n)
+{
+  struct hblock *d, *best = 0;
+  int b;
+
+  switch(a->strategy) {
+  case STRATEGY_FIRST_FIT: // first on the list that fits
+    for(d = a->heap; d; d = d->next)
+      if(d->size >= n)
+        return d;
+    return 0;
+  case STRATEGY_NEXT_FIT: // first fit, starting where the last one stopped
+    for(d = a->rover; d; d = d->next)
+      if(d->size >= n)
+        return d;
+    for(d = a->heap; d && d != a->rover; d = d->next)
+      if(d->size >= n)
+        return d;
+    return 0;
+  case STRATEGY_WORST_FIT: // largest, in the top bin that isn't empty
+    for(b = NHEAPBIN - 1; b >= 0 && a->bins[b] == 0; b--)
+      ;
+    for(d = b >= 0 ? a->bins[b] : 0; d; d = d->bnext)
+      if(d->size >= n && (best == 0 || d->size > best->size))
+        best = d;
+    return best;
+  default: // best fit: smallest that fits, in the first bin that has one
+    for(b = heap_bin(n); (b = bin_next(a, b)) >= 0; b++) {
+      if(b < HEAP_EXACT)
+        return a->bins[b];
+      for(d = a->bins[b]; d; d = d->bnext) {
+        if(d->size >= n && (best == 0 || d->size < best->size)) {
+          best = d;
+          if(d->size == n)
+            break;
+        }
+      }
+      if(best)
+        return best;
+    }
+    return 0;
+  }
+}
+
+// Add a new, zeroed chunk to the arena's heap as one free block,
+// and return that block. Caller holds a->lock.
+static struct hblock*
+heap_grow(struct arena *a)
+{
+  struct hblock *d;
+  char *chunk;
+  int i;
+
+  if((d = hblock_get(a)) == 0)
+    return 0;
+  if((chunk = kalloc_pages(HEAP_CHUNK_ORDER)) == 0) {
+    hblock_put(a, d);
+    return 0;
+  }
+  memset(chunk, 0, HEAP_CHUNK);
+  for(i = 0; i < (1 << HEAP_CHUNK_ORDER); i++) {
+    PGHDR(chunk + i * PGSIZE)->kind = BLK_HEAP;
+    PGHDR(chunk + i * PGSIZE)->chunk = PGHDR(chunk);
+  }
+  PGHDR(chunk)->npages = 1 << HEAP_CHUNK_ORDER;
+  owned_add(a, PGHDR(chunk));
+  a->nchunk++;
+
+  d->addr = chunk;
+  d->size = HEAP_CHUNK;
+  d->req = 0;
+  d->anext = d->aprev = 0;
+  heap_push(a, d);
+  return d;
+}
+
+// Allocate a heap block for a size-byte request, placed by the
+// arena's strategy. What the block doesn't need is split off
+// and stays free. Caller holds a->lock.
+static void*
+heap_alloc(struct arena *a, uint size)
+{
+  uint n = round_up(size) + sizeof(struct heap_tag);
+  struct hblock *d, *rest = 0;
+  struct heap_tag *t;
+
+  if((d = heap_find(a, n)) == 0 && (d = heap_grow(a)) == 0)
+    return 0;
+
+  // The block is taken from the front, the rest follows it in
+  // the chunk and takes its place on the list
+  if(d->size - n >= HEAP_MIN && (rest = hblock_get(a)) != 0) {
+    rest->addr = d->addr + n;
+    rest->size = d->size - n;
+    rest->req = 0;
+    rest->aprev = d;
+    rest->anext = d->anext;
+    if(d->anext)
+      d->anext->aprev = rest;
+    d->anext = rest;
+    d->size = n;
+    heap_replace(a, d, rest);
+    a->rover = rest;
+  } else {
+    heap_unlink(a, d);
+    a->rover = d->next;
+  }
+
+  d->req = size;
+  t = (struct heap_tag*)d->addr;
+  t->desc = HINDEX(d);
+  t->magic = MAGIC_NUMBER;
+  account(a, size, d->size);
+  return (void*)(t + 1);
+}
+
+// Take the chunk that the free block d spans out of the arena's
+// heap and unmap it from pagetable, unless that is 0. Its pages
+// are returned in *large, for the caller to give back with
+// free_run() once a->lock is released. Caller holds a->lock.
+static void
+heap_release(struct arena *a, pagetable_t pagetable, struct hblock *d,
+             struct block_header **large)
+{
+  char *chunk = d->addr;
+  int i;
+
+  heap_unlink(a, d);
+  hblock_put(a, d);
+  if(pagetable)
+    uvmunmap(pagetable, UVA(chunk), 1 << HEAP_CHUNK_ORDER, 0);
+  for(i = 0; i < (1 << HEAP_CHUNK_ORDER); i++)
+    PGHDR(chunk + i * PGSIZE)->kind = BLK_NONE;
+  owned_del(a, PGHDR(chunk));
+  a->nchunk--;
+  *large = PGHDR(chunk);
+}
+
+// Free the heap block at ptr and merge it with the free blocks
+// on either side. Returns -1 if ptr is not a heap block of this
+// arena that is handed out. A chunk that is left empty is
+// handled as in heap_release(). Caller holds a->lock.
+static int
+heap_free(struct arena *a, pagetable_t pagetable, char *ptr, struct block_header **large)
+{
+  struct heap_tag *t = (struct heap_tag*)ptr - 1;
+  struct hblock *d, *n;
+  int listed = 0;
+
+  // The tag is user memory: it has to name one of this
+  // arena's descriptors, and that has to name it back. A
+  // descriptor page of an exited process in the same slot
+  // may still sit on the reclaim list, the gen tells it apart.
+  if((uint64)ptr % (1 << ALIGNMENT) != 0 || PG2PA(t->desc >> 7) >= kmem.top || (t->desc & 127) >= HSLOTS)
+    return -1;
+  d = HDESC(t->desc);
+  if(PGHDR(d)->kind != BLK_HMETA || PGHDR(d)->arena != a ||
+     PGHDR(d)->size != a->gen || d->addr != (char*)t || d->req == 0)
+    return -1;
+
+  account(a, d->req, -(long)d->size);
+  d->req = 0;
+
+  // A free block after d is absorbed, d takes its place on the list
+  if((n = d->anext) != 0 && n->req == 0) {
+    d->size += n->size;
+    if((d->anext = n->anext) != 0)
+      d->anext->aprev = d;
+    heap_replace(a, n, d);
+    hblock_put(a, n);
+    listed = 1;
+  }
+  // and a free block before d absorbs it
+  if((n = d->aprev) != 0 && n->req == 0) {
+    n->size += d->size;
+    if((n->anext = d->anext) != 0)
+      n->anext->aprev = n;
+    if(listed)
+      heap_unlink(a, d);
+    hblock_put(a, d);
+    bin_del(a, n); // bigger now
+    bin_add(a, n);
+    d = n;
+  } else if(!listed) {
+    heap_push(a, d);
+  }
+
+  if(d->size == HEAP_CHUNK && a->nchunk > 1)
+    heap_release(a, pagetable, d, large);
+  return 0;
+}
+
+// Initialize custom student allocator; kinit() calls it once
+void
+student_init()
+{
+  if(student_mem.initialized)
+    return; // Already initialized
+  
+  initlock(&student_mem.lock, "student_mem"); // Initialize lock
+  for(int i = 0; i < NPROC; i++) {
+    initlock(&student_arenas[i].lock, "arena");
+    student_arenas[i].strategy = ALLOCATION_STRATEGY;
+  }
+  student_mem.freelist = 0;
+  student_mem.num_free = 0;
+  
+  // Pre-allocate FREE_LIST_SIZE pages, all in one kalloc_batch()
+  void* chain;
+  kalloc_batch(&chain, FREE_LIST_SIZE); //20 pages, fewer if kalloc failed
+  while(chain) {
+    void* page = chain;
+    chain = *(void**)page;
+    struct block_header* b = PGHDR(page);
+    b->kind = BLK_FREE;
+    b->next = student_mem.freelist;
+    student_mem.freelist = b;
+    student_mem.num_free++;
+  }
+  
+  student_mem.initialized = 1; // Mark as initialized
+}
+
+// Allocate a block for a request that fits in one page: from
+// the heap, or a slab object or page block under
+// STRATEGY_SEGREGATED_FIT. Caller holds a->lock.
+static void*
+small_alloc(struct arena *a, uint size)
+{
+  if(a->strategy != STRATEGY_SEGREGATED_FIT)
+    return heap_alloc(a, size);
+
+  // Small requests share a page with other objects of the same size class
+  if(size <= SLAB_MAX)
+    return slab_alloc(a, size);
+  
+  // Every page block is the same size, so any free page is the best fit:
+  // take the head of the free list, O(1).
+  char* page = pool_get(a);
+  if(page == 0) //kalloc failed
+    return 0;
+  
+  // Now mark block as allocated
+  struct block_header* best = PGHDR(page);
+  best->kind = BLK_BLOCK;
+  best->size = size;
+  best->npages = 1;
+  account(a, size, PGSIZE);
+  
+  // No header in the page any more, the user gets all of it
+  return page;
+}
+
+// The valid leaf PTE that maps va in pagetable, or 0. Unlike
+// walk(), stops at a megapage, a leaf at level 1, and says in
+// *level where the leaf was found.
+static pte_t*
+leaf_pte(pagetable_t pagetable, uint64 va, int *level)
+{
+  pte_t* pte;
+  int l;
+
+  for(l = 2; ; l--) {
+    pte = &pagetable[PX(l, va)];
+    if((*pte & PTE_V) == 0)
+      return 0;
+    if(l == 0 || (*pte & (PTE_R | PTE_W | PTE_X)) != 0)
+      break;
+    pagetable = (pagetable_t)PTE2PA(*pte);
+  }
+  *level = l;
+  return pte;
+}
+
+// Map the 2 MB at pa, which is aligned to 2 MB, at va with one
+// level-1 leaf with permissions perm. A page-table page left
+// empty there by earlier 4096-byte mappings is freed first.
+// Returns -1 if the level-1 slot is in use or there is no memory
+// for a page-table page.
+static int
+map_super(pagetable_t pagetable, uint64 va, char* pa, int perm)
+{
+  pte_t* pte = &pagetable[PX(2, va)];
+  pagetable_t l1, l0;
+  int i;
+
+  if((*pte & PTE_V) == 0) {
+    if((l1 = kalloc_zeroed()) == 0)
+      return -1;
+    *pte = PA2PTE(l1) | PTE_V;
+  }
+  l1 = (pagetable_t)PTE2PA(*pte);
+  pte = &l1[PX(1, va)];
+  if(*pte & (PTE_R | PTE_W | PTE_X))
+    return -1; // a megapage already
+  if(*pte & PTE_V) {
+    l0 = (pagetable_t)PTE2PA(*pte);
+    for(i = 0; i < 512; i++)
+      if(l0[i] & PTE_V)
+        return -1;
+    kfree(l0);
+  }
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  __sync_fetch_and_add(&student_mem.nsuper, 1);
+  return 0;
+}
+
+// Unmap npages pages of the student window from va, mapped
+// with 4096-byte pages or megapages that lie wholly inside.
+static void
+unmap_window(pagetable_t pagetable, uint64 va, uint npages)
+{
+  pte_t* pte;
+  int level;
+  uint i;
+
+  for(i = 0; i < npages; i += level ? 1 << SUPERORDER : 1) {
+    level = 0;
+    if((pte = leaf_pte(pagetable, va + (uint64)i * PGSIZE, &level)) != 0)
+      *pte = 0;
+  }
+}
+
+// Map the pages holding the block at ptr into pagetable, if they
+// aren't already, and return the block's user address. Every
+// 2 MB-aligned 2 MB of a large block gets a megapage, which
+// saves TLB entries and page-table pages; the rest, or all of it
+// if map_super() can't, gets 4096-byte pages. Returns 0 if a
+// page-table page can't be allocated.
+// Caller holds the arena's lock.
+static uint64
+map_block(pagetable_t pagetable, void* ptr)
+{
+  struct block_header* b = PGHDR(ptr);
+  char* page;
+  uint i, n;
+  int level;
+
+  if(b->kind == BLK_HEAP) // a heap chunk is mapped as a whole
+    b = b->chunk;
+  page = HDRPAGE(b);
+  n = b->kind == BLK_SLAB ? 1 : b->npages;
+
+  // slab page or chunk that already holds blocks of this process
+  if(leaf_pte(pagetable, UVA(page), &level))
+    return UVA(ptr);
+
+  for(i = 0; i < n; i++) {
+    if((uint64)(page + i * PGSIZE) % SUPERPGSIZE == 0 && i + (1 << SUPERORDER) <= n &&
+       map_super(pagetable, UVA(page + i * PGSIZE), page + i * PGSIZE, PTE_R | PTE_W | PTE_U) == 0) {
+      i += (1 << SUPERORDER) - 1;
+      continue;
+    }
+    if(mappages(pagetable, UVA(page + i * PGSIZE), PGSIZE, (uint64)page + i * PGSIZE, PTE_R | PTE_W | PTE_U) != 0) {
+      unmap_window(pagetable, UVA(page), i);
+      return 0;
+    }
+  }
+  return UVA(ptr);
+}
+
+// Free the block at ptr, which belongs to arena a. Caller holds a->lock.
+// Returns -1 if ptr is not a live student_malloc block.
+// The block is unmapped from pagetable, unless that is 0.
+// A large block, or a heap chunk left empty, leaves the arena and its header is returned in *large;
+// the caller gives its pages back with free_run() once the lock is released.
+static int
+free_locked(struct arena *a, pagetable_t pagetable, char* ptr, struct block_header** large)
+{
+  struct block_header* block = PGHDR(ptr);
+  struct slab* s;
+  
+  // Heap chunks stay mapped for as long as the arena has them
+  if(block->kind == BLK_HEAP)
+    return heap_free(a, pagetable, ptr, large);
+
+  // Slab pages hold many objects
+  if(block->kind == BLK_SLAB) {
+    s = block->slab;
+    if(slab_free(a, s, ptr) < 0)
+      return -1;
+    // Nothing of this process is left in the page
+    if(s->inuse == 0 && pagetable)
+      uvmunmap(pagetable, UVA(PGROUNDDOWN((uint64)ptr)), 1, 0);
+    return 0;
+  }
+  
+  // Otherwise it has to be the start of an allocated block (this also
+  // catches double frees)
+  if(block->kind != BLK_BLOCK || ((uint64)ptr % PGSIZE) != 0)
+    return -1;
+  
+  account(a, block->size, -(long)block->npages * PGSIZE);
+  
+  // The page goes back to the pool or the buddy allocator,
+  // this process must not be able to touch it anymore
+  if(pagetable)
+    unmap_window(pagetable, UVA(ptr), block->npages);
+  
+  // Large blocks go straight back to the buddy allocator
+  if(block->npages > 1) {
+    block->kind = BLK_NONE;
+    owned_del(a, block);
+    *large = block;
+    return 0;
+  }
+  
+  // Single pages go back on the head of the free list, O(1)
+  pool_put(a, ptr);
+  return 0;
+}
+
+// The kernel address of the block at user address va, or 0 if
+// va isn't in the student window or pagetable doesn't map it there.
+static char*
+user_block(pagetable_t pagetable, uint64 va)
+{
+  pte_t* pte;
+  int level;
+
+  if(va < USTUDENT || va >= UVA(phystop) ||
+     (pte = leaf_pte(pagetable, va, &level)) == 0 || (*pte & PTE_U) == 0 ||
+     PTE2PA(*pte) != ((uint64)KVA(va) & ~((PGSIZE << (9 * level)) - 1)))
+    return 0;
+  return KVA(va);
+}
+
+// Give back a block that was allocated but could not be mapped.
+static void
+undo_alloc(struct arena *a, void* ptr)
+{
+  struct block_header* large = 0;
+
+  acquire(&a->lock);
+  free_locked(a, 0, ptr, &large);
+  release(&a->lock);
+  if(large)
+    free_run(HDRPAGE(large), 0, large->npages);
+}
+
+// student_malloc() without the histograms.
+static uint64
+arena_malloc(struct proc *p, uint size)
+{
+  struct arena *a = &student_arenas[p - proc];
+  uint64 va;
+  void* ptr;
+  
+  //if allocating 0 bytes then return 0
+  if(size == 0)
+    return 0;
+  
+  // Bigger than a page: contiguous pages straight from the buddy allocator
+  if(size > PGSIZE) {
+    if((ptr = large_alloc(a, size)) == 0)
+      return 0;
+  }
+  
+  //getting the lock, to avoid race conditions
+  acquire(&a->lock);
+  if(size <= PGSIZE && (ptr = small_alloc(a, size)) == 0) {
+    release(&a->lock);
+    return 0;
+  }
+  va = map_block(p->pagetable, ptr);
+  release(&a->lock); // Unlock (done modifying)
+  
+  if(va == 0) // out of page-table pages
+    undo_alloc(a, ptr);
+  return va;
+}
+
+// Allocate memory using custom allocator and map it into
+// process p. Returns the user address, or 0 on failure.
+uint64
+student_malloc(struct proc *p, uint size)
+{
+  uint64 t0 = r_time();
+  uint64 va = arena_malloc(p, size);
+
+  hist_add(HIST_MALLOC_SIZE, size);
+  hist_add(HIST_MALLOC_TIME, r_time() - t0);
+  return va;
+}
+
+// Allocate n blocks, sizes[i] bytes each, mapped into process p, and
+// store their user addresses in vas[i] (0 when that allocation fails
+// or sizes[i] is 0). All the slab and page blocks are taken under a
+// single hold of the arena's lock.
+// Returns the number of blocks allocated.
+int
+student_malloc_batch(struct proc *p, uint* sizes, uint64* vas, int n)
+{
+  struct arena *a = &student_arenas[p - proc];
+  int i, got = 0;
+  void* ptr;
+  
+  for(i = 0; i < n; i++) {
+    hist_add(HIST_MALLOC_SIZE, sizes[i]);
+    vas[i] = 0;
+    if(sizes[i] > PGSIZE && (ptr = large_alloc(a, sizes[i])) != 0)
+      vas[i] = (uint64)ptr; // mapped below
+  }
+  
+  acquire(&a->lock);
+  for(i = 0; i < n; i++) {
+    if(sizes[i] == 0 || (sizes[i] > PGSIZE && vas[i] == 0))
+      continue;
+    ptr = sizes[i] > PGSIZE ? (void*)vas[i] : small_alloc(a, sizes[i]);
+    vas[i] = ptr ? map_block(p->pagetable, ptr) : 0;
+    if(ptr && vas[i] == 0)
+      vas[i] = (uint64)ptr | 1; // couldn't map, given back below
+    else if(vas[i])
+      got++;
+  }
+  release(&a->lock);
   
-  *magic = MAGIC_NUMBER;
-  *strategy = ALLOCATION_STRATEGY;
-  *num_alloc = student_mem.num_allocated; //number of currently allocated blocks
-  *total_alloc = student_mem.total_allocated; //total size of all allocated blocks
-  *num_free = student_mem.num_free;
+  for(i = 0; i < n; i++) {
+    if(vas[i] & 1) {
+      undo_alloc(a, (void*)(vas[i] & ~1L));
+      vas[i] = 0;
+    }
+  }
+  return got;
+}
+
+// student_free() without the histograms.
+static int
+arena_free(struct proc *p, uint64 va)
+{
+  struct arena *a = &student_arenas[p - proc];
+  struct block_header* large = 0;
+  char* ptr;
+  int r;
+  
+  if(va == 0)
+    return 0; //nothing to free
+  
+  // Only p's own arena has pages mapped in p
+  if((ptr = user_block(p->pagetable, va)) == 0)
+    return -1;
+  
+  acquire(&a->lock); // Lock for thread safety
+  r = free_locked(a, p->pagetable, ptr, &large);
+  release(&a->lock);
+  
+  if(large)
+    free_run(HDRPAGE(large), 0, large->npages);
+  return r;
+}
+
+// Free memory allocated by student_malloc, given its user address.
+// Returns -1 if va isn't a block process p can free.
+int
+student_free(struct proc *p, uint64 va)
+{
+  uint64 t0 = r_time();
+  int r = arena_free(p, va);
+
+  hist_add(HIST_FREE_TIME, r_time() - t0);
+  return r;
+}
+
+// Free the n blocks whose user addresses are in vas (0 entries are
+// skipped) under a single hold of the arena's lock. Overwrites vas.
+// Returns -1 if any of them could not be freed.
+int
+student_free_batch(struct proc *p, uint64* vas, int n)
+{
+  struct arena *a = &student_arenas[p - proc];
+  struct block_header* large;
+  char* ptr;
+  int i, r = 0;
   
+  acquire(&a->lock);
+  for(i = 0; i < n; i++) {
+    large = 0;
+    if(vas[i] && ((ptr = user_block(p->pagetable, vas[i])) == 0 ||
+                  free_locked(a, p->pagetable, ptr, &large) < 0))
+      r = -1;
+    vas[i] = (uint64)large; // keep large blocks for below
+  }
+  release(&a->lock);
+  
+  for(i = 0; i < n; i++) {
+    large = (struct block_header*)vas[i];
+    if(large)
+      free_run(HDRPAGE(large), 0, large->npages);
+  }
+  return r;
+}
+
+// Drop every student allocator mapping from pagetable, and the
+// page-table pages holding them, without freeing the memory.
+// Must run before uvmfree() tears down an exiting process's
+// page table, which would otherwise panic on these leaves.
+void
+student_unmap(pagetable_t pagetable)
+{
+  pagetable_t l1;
+  void* chain = 0; // page-table pages, freed together at the end
+  void* pt;
+  int i, j;
+
+  for(i = PX(2, USTUDENT); i < PX(2, USTUDENT) + USTUDENT_SIZE / (1L << PXSHIFT(2)); i++) {
+    if((pagetable[i] & PTE_V) == 0)
+      continue;
+    l1 = (pagetable_t)PTE2PA(pagetable[i]);
+    for(j = 0; j < 512; j++) {
+      // a leaf table, the leaves just go away, or a megapage
+      if((l1[j] & PTE_V) && (l1[j] & (PTE_R | PTE_W | PTE_X)) == 0) {
+        pt = (void*)PTE2PA(l1[j]);
+        *(void**)pt = chain;
+        chain = pt;
+      }
+    }
+    *(void**)l1 = chain;
+    chain = l1;
+    pagetable[i] = 0;
+  }
+  kfree_batch(chain);
+}
+
+// Process p is exiting, or replacing its memory in exec: let go
+// of its shared memory segments, drop its student allocator
+// mappings and hand its whole arena,
+// leaked blocks included, to student_mem.reclaim in one splice.
+// The arena is left empty for the next process in p's slot.
+void
+student_exit(struct proc *p)
+{
+  struct arena *a = &student_arenas[p - proc];
+  int id;
+
+  // shared memory segments first, their pages hold references
+  acquire(&shm.lock);
+  for(id = 0; id < NSHM; id++)
+    if(shm.held[p - proc] & (1 << id))
+      shm_release(p, id);
+  release(&shm.lock);
+  memset(&memacct.proc[p - proc], 0, sizeof(struct procacct));
+
+  student_unmap(p->pagetable);
+
+  acquire(&a->lock);
+  acquire(&student_mem.lock);
+  if(a->owned) {
+    a->owned_tail->onext = student_mem.reclaim;
+    if(student_mem.reclaim == 0)
+      student_mem.reclaim_tail = a->owned_tail;
+    student_mem.reclaim = a->owned;
+  }
   release(&student_mem.lock);
+  // leaked blocks count as freed
+  __sync_fetch_and_add(&student_mem.nfree, a->num_allocated);
+  __sync_fetch_and_sub(&student_mem.num_allocated, a->num_allocated);
+  __sync_fetch_and_sub(&student_mem.total_allocated, a->total_allocated);
+  __sync_fetch_and_sub(&student_mem.arena_free, a->num_free + a->num_heap);
+  __sync_fetch_and_sub(&student_mem.arena_pages, a->npages);
+  __sync_fetch_and_sub(&student_mem.reserved, a->reserved);
+  a->freelist = 0;
+  a->free_slabs = 0;
+  memset(a->slabs, 0, sizeof(a->slabs));
+  a->owned = a->owned_tail = 0;
+  a->heap = a->rover = 0;
+  a->free_hblocks = 0;
+  memset(a->bins, 0, sizeof(a->bins));
+  a->binmap[0] = a->binmap[1] = 0;
+  a->strategy = ALLOCATION_STRATEGY;
+  a->gen++;
+  a->num_allocated = 0;
+  a->total_allocated = 0;
+  a->num_free = 0;
+  a->num_empty = 0;
+  a->num_heap = 0;
+  a->nchunk = 0;
+  a->npages = 0;
+  a->reserved = 0;
+  release(&a->lock);
+}
+
+// Set process p's allocation strategy to s, one of STRATEGY_*,
+// or just look it up if s is -1. Blocks that are already handed
+// out can still be freed after a change.
+// Returns the strategy p had, or -1 if s isn't one.
+int
+student_strategy(struct proc *p, int s)
+{
+  struct arena *a = &student_arenas[p - proc];
+  int old;
+
+  if(s < -1 || s >= NSTRATEGY)
+    return -1;
+
+  acquire(&a->lock);
+  old = a->strategy;
+  if(s >= 0) {
+    a->strategy = s;
+    a->rover = 0;
+  }
+  release(&a->lock);
+  return old;
+}
+
+// Give up to n pieces from student_mem.reclaim (all of them if
+// n < 0) back to the buddy allocator, under one hold of kmem.lock.
+// Returns the number of pages given back.
+static int
+student_reclaim(int n)
+{
+  struct block_header *b, *chain, *next;
+  uint lo, hi;
+  char *base;
+  int k, npages = 0;
+
+  if(student_mem.reclaim == 0)
+    return 0;
+
+  acquire(&student_mem.lock);
+  if((chain = b = student_mem.reclaim) == 0) {
+    release(&student_mem.lock);
+    return 0;
+  }
+  if(n < 0)
+    b = student_mem.reclaim_tail;
+  for(k = 1; k < n && b->onext; k++)
+    b = b->onext;
+  if((student_mem.reclaim = b->onext) == 0)
+    student_mem.reclaim_tail = 0;
+  b->onext = 0;
+  release(&student_mem.lock);
+
+  acquire(&kmem.lock);
+  for(b = chain; b; b = next) {
+    next = b->onext;
+    base = HDRPAGE(b);
+    hi = b->npages;
+    for(lo = 0; lo < hi; lo++) // heap chunks mark every page
+      PGHDR(base + (uint64)lo * PGSIZE)->kind = BLK_NONE;
+    npages += hi;
+    // same split into aligned pieces as free_run()
+    for(lo = 0; lo < hi; lo += 1U << k) {
+      for(k = 0; k < MAXORDER && (lo & ((2U << k) - 1)) == 0 && lo + (2U << k) <= hi; k++)
+        ;
+      JUNK(base + (uint64)lo * PGSIZE, (uint64)PGSIZE << k, 1);
+      buddy_free((struct run*)(base + (uint64)lo * PGSIZE), k);
+    }
+  }
+  release(&kmem.lock);
+  return npages;
+}
+
+
+// Count v in histogram h of the running CPU.
+static void
+hist_add(int h, uint64 v)
+{
+  int b;
+
+  for(b = 0; v > 1 && b < HIST_NBUCKET - 1; b++)
+    v >>= 1;
+  push_off();
+  cpuhist[cpuid()].count[h][b]++;
+  pop_off();
+}
+
+// Add up every CPU's histograms into *h, and clear them if reset
+// is set. Counts that land while this runs may go either way.
+void
+allochist_read(struct allochist *h, int reset)
+{
+  int i, j, b;
+
+  memset(h, 0, sizeof(*h));
+  for(i = 0; i < NCPU; i++) {
+    for(j = 0; j < NHIST; j++) {
+      for(b = 0; b < HIST_NBUCKET; b++) {
+        h->count[j][b] += cpuhist[i].count[j][b];
+        if(reset)
+          cpuhist[i].count[j][b] = 0;
+      }
+    }
+  }
+}
+
+// Give the pages of the student_mem reserve beyond keep back
+// to the buddy allocator, under one hold of kmem.lock.
+// Returns the number of pages given back.
+static int
+student_trim(uint keep)
+{
+  struct block_header *b, *chain = 0;
+  int n = 0;
+
+  if(student_mem.num_free <= keep)
+    return 0;
+
+  acquire(&student_mem.lock);
+  while(student_mem.num_free > keep) {
+    b = student_mem.freelist;
+    student_mem.freelist = b->next;
+    student_mem.num_free--;
+    b->next = chain;
+    chain = b;
+  }
+  release(&student_mem.lock);
+
+  acquire(&kmem.lock);
+  for(b = chain; b; b = chain) {
+    chain = b->next;
+    b->kind = BLK_NONE;
+    JUNK(HDRPAGE(b), PGSIZE, 1);
+    buddy_free((struct run*)HDRPAGE(b), 0);
+    n++;
+  }
+  release(&kmem.lock);
+  return n;
+}
+
+// Take a snapshot of the student allocator and kmem for the
+// memstats system call and the stats page. No locks are taken:
+// the student counters are global sums kept with atomics, and
+// kmem's and the caches' free counts are read as they are, so a
+// page moving between them just then can be counted twice or
+// missed, which a snapshot can live with. strategy is left at
+// the default; callers that report a process's fill it in.
+void
+student_memstats(struct memstats *st)
+{
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  st->version = MEMSTATS_VERSION;
+  st->size = sizeof(*st);
+  st->magic = MAGIC_NUMBER;
+  st->strategy = ALLOCATION_STRATEGY;
+
+  st->num_allocated = student_mem.num_allocated;
+  st->total_allocated = student_mem.total_allocated;
+  st->num_free = student_mem.num_free + student_mem.arena_free;
+  st->student_pages = student_mem.num_free + student_mem.arena_pages;
+  st->nalloc = student_mem.nalloc;
+  st->nfree = student_mem.nfree;
+  st->bytes_reserved = student_mem.reserved;
+  st->peak_reserved = student_mem.peak;
+  st->nsuper = student_mem.nsuper;
+  st->lazy_faults = lazy.nfault;
+  st->lazy_pages = lazy.npages;
+
+  st->kmem_total = kmem.npages;
+  st->kmem_free = kmem.nfree;
+  for(i = 0; i < NCPU; i++)
+    st->kmem_free += kcache[i].nfree;
+  st->kmem_free += kzero.nfree;
+}
+
+// Republish the memstats in the stats page. Called on every
+// clock tick by CPU 0's clockintr(), the only writer, so a seq
+// increment needs no lock; readers retry while it is odd.
+void
+statpage_update(void)
+{
+  struct memstats st;
+
+  student_memstats(&st);
+
+  statpage->seq++;
+  __sync_synchronize();
+  memmove(&statpage->st, &st, sizeof(st));
+  statpage->ticks = ticks;
+  __sync_synchronize();
+  statpage->seq++;
+}
+
+// Map the stats page read-only at USTATS in a new process's
+// page table. Returns -1 if a page-table page can't be allocated.
+int
+statpage_map(pagetable_t pagetable)
+{
+  return mappages(pagetable, USTATS, PGSIZE, (uint64)statpage, PTE_R | PTE_U);
+}
+
+// Add the mappings in the page-table page pt, which is at
+// level and maps from va up, to a. *below counts the pages
+// under p->sz, guard page included.
+static void
+memacct_walk(struct proc *p, pagetable_t pt, int level, uint64 va,
+             struct procacct *a, uint64 *below)
+{
+  uint64 pgva, n;
+  pte_t pte;
+  int i;
+
+  for(i = 0; i < 512; i++){
+    pte = pt[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    pgva = va + ((uint64)i << PXSHIFT(level));
+    if(level > 0 && (pte & (PTE_R | PTE_W | PTE_X)) == 0){
+      a->ptpages++;
+      memacct_walk(p, (pagetable_t)PTE2PA(pte), level - 1, pgva, a, below);
+      continue;
+    }
+    n = 1L << (9 * level);
+    if(pgva < p->sz){
+      *below += n;
+    } else if((pte & PTE_U) == 0 || (pgva >= USTUDENT && pgva < USTUDENT_TOP) ||
+              pgva == USTATS){
+      continue; // trampoline, trapframe, student blocks, which the arena counts, or stats page
+    }
+    a->resident += n;
+    if((pgva >= USHM && pgva < USHM_TOP) || kref_count((void*)PTE2PA(pte)) > 1)
+      a->shared += n;
+  }
+}
+
+// Recount process p's memory. The caller must keep p's page
+// table from changing underneath, see memacct_read().
+static void
+memacct_update(struct proc *p)
+{
+  struct procacct a;
+  uint64 below = 0;
+
+  memset(&a, 0, sizeof(a));
+  a.ptpages = 1;
+  memacct_walk(p, p->pagetable, 2, 0, &a, &below);
+  a.lazy = PGROUNDUP(p->sz) > below * PGSIZE ? PGROUNDUP(p->sz) - below * PGSIZE : 0;
+  memacct.proc[p - proc] = a;
+}
+
+// Fill in pm for the process in proc[] slot i, recounting its
+// memory first. A page table only changes while its process
+// runs, or under p->lock in fork() and wait(), so it can be
+// walked under p->lock unless p is running on another CPU;
+// such a process gets the numbers from its last count.
+// Returns -1 if the slot is unused.
+int
+memacct_read(int i, struct procmem *pm)
+{
+  struct proc *p = &proc[i];
+  struct procacct *a = &memacct.proc[i];
+
+  acquire(&p->lock);
+  if(p->state == UNUSED){
+    release(&p->lock);
+    return -1;
+  }
+  if(p->pagetable && (p == myproc() || p->state != RUNNING))
+    memacct_update(p);
+  pm->pid = p->pid;
+  safestrcpy(pm->name, p->name, sizeof(pm->name));
+  release(&p->lock);
+
+  pm->resident = a->resident;
+  pm->shared = a->shared;
+  pm->ptpages = a->ptpages;
+  pm->lazy = a->lazy;
+  pm->student = student_arenas[i].reserved;
+  return 0;
+}
+
+// Get detailed memory statistics for system call
+// decided to modify the signature as i see fit for student stats
+void
+student_get_stats(uint* magic, uint* strategy, uint* num_alloc, uint* total_alloc, uint* num_free)
+{
+  struct memstats st;
+
+  student_memstats(&st);
+  *magic = st.magic;
+  *strategy = student_strategy(myproc(), -1);
+  *num_alloc = st.num_allocated; //number of currently allocated blocks
+  *total_alloc = st.total_allocated; //total size of all allocated blocks
+  *num_free = st.num_free;
 }
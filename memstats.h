@@ -0,0 +1,60 @@
+// Snapshot of the memory allocators, filled in by the
+// memstats() system call with a single copyout.
+// New fields only ever go at the end and bump
+// MEMSTATS_VERSION; the kernel copies no more than the
+// size the caller passes, so old programs keep working.
+#define MEMSTATS_VERSION 3
+
+struct memstats {
+  uint version;          // MEMSTATS_VERSION of the running kernel
+  uint size;             // sizeof(struct memstats) in the running kernel
+
+  // the getmemstats() values
+  uint magic;
+  uint strategy;
+  uint num_allocated;    // live student_malloc blocks
+  uint total_allocated;  // bytes requested for them
+  uint num_free;         // free student pages plus cached empty slabs
+  uint student_pages;    // pages held by the arenas and the reserve
+
+  uint64 bytes_reserved; // bytes set aside for live blocks, rounding included
+  uint64 peak_reserved;  // highest bytes_reserved since boot
+  uint64 nalloc;         // blocks handed out since boot
+  uint64 nfree;          // blocks freed since boot, leaked ones reclaimed at exit included
+
+  uint kmem_total;       // pages kinit() gave to kmem
+  uint kmem_free;        // free pages in kmem, the per-CPU caches and the zeroed pool
+
+  // version 2
+  uint64 nsuper;         // 2 MB megapage mappings made since boot
+
+  // version 3
+  uint64 lazy_faults;    // page faults on sbrklazy() memory since boot
+  uint64 lazy_pages;     // pages those faults mapped, fault-around included
+};
+
+// One process's memory, from the procmem() system call.
+// The page counts are taken when procmem() is called, except
+// for a process running on another CPU, whose counts are from
+// the last call that could walk its page table.
+struct procmem {
+  int pid;
+  char name[16];
+  uint64 resident;       // user pages mapped, copy-on-write and shared ones included
+  uint64 shared;         // of those, pages other processes map too
+  uint64 ptpages;        // page-table pages
+  uint64 lazy;           // bytes of sbrklazy() memory not faulted in yet
+  uint64 student;        // bytes its student_malloc blocks reserve
+};
+
+// The kernel also publishes struct memstats every clock tick in
+// a read-only page mapped at USTATS (kernel/student.h) in every
+// process, which fastmemstats() reads without a system call.
+// seq is odd while the kernel is writing the page; a reader
+// copies st until it sees the same even seq before and after.
+// strategy there is always the default, not the reader's.
+struct memstats_page {
+  uint seq;              // 0 until the first update
+  uint ticks;            // when st was written
+  struct memstats st;
+};
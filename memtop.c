@@ -0,0 +1,56 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstats.h"
+#include "user/user.h"
+
+// List processes by how much memory they use, largest first.
+// memtop       every process
+// memtop -n k  only the k largest
+// Sizes are in KB. total counts resident and page-table pages
+// plus student_malloc memory; lazy is sbrklazy() memory that
+// hasn't been touched yet, and isn't in total.
+
+static struct procmem pm[NPROC];
+
+static uint64
+footprint(struct procmem *m)
+{
+  return (m->resident + m->ptpages) * 4 + m->student / 1024;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, j, max = NPROC;
+  struct procmem t;
+
+  if(argc == 3 && strcmp(argv[1], "-n") == 0) {
+    max = atoi(argv[2]);
+  } else if(argc != 1) {
+    fprintf(2, "usage: memtop [-n count]\n");
+    exit(1);
+  }
+
+  if((n = procmem(pm, NPROC)) < 0) {
+    fprintf(2, "memtop: procmem failed\n");
+    exit(1);
+  }
+
+  // insertion sort, largest footprint first
+  for(i = 1; i < n; i++) {
+    t = pm[i];
+    for(j = i; j > 0 && footprint(&pm[j - 1]) < footprint(&t); j--)
+      pm[j] = pm[j - 1];
+    pm[j] = t;
+  }
+
+  printf("pid\tname\ttotal\tresident\tshared\tpagetbl\tstudent\tlazy\n");
+  for(i = 0; i < n && i < max; i++) {
+    printf("%d\t%s\t%lu\t%lu\t\t%lu\t%lu\t%lu\t%lu\n", pm[i].pid, pm[i].name,
+           footprint(&pm[i]), pm[i].resident * 4, pm[i].shared * 4,
+           pm[i].ptpages * 4, pm[i].student / 1024, pm[i].lazy / 1024);
+  }
+
+  exit(0);
+}
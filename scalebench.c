@@ -0,0 +1,172 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Multi-core scalability benchmark. For every test and every
+// worker count 1..max, forks that many workers, releases them
+// together, and times until the last one is done. Each worker
+// does the same fixed amount of work, so a flat ticks column
+// means perfect scaling. Prints
+//   scalebench,<test>,<workers>,<ops>,<ticks>
+// where ops is the total over all workers.
+//
+// scalebench [-n maxworkers] [test]
+// maxworkers defaults to the CPUS the kernel was built for.
+
+#ifndef CPUS
+#define CPUS 3
+#endif
+
+#define ITERS 2000
+
+// Grow the heap by 16 pages with sbrk and give them back.
+static int
+eager(void)
+{
+  for(int i = 0; i < ITERS / 10; i++) {
+    if(sbrk(16 * 4096) == SBRK_ERROR)
+      return -1;
+    sbrk(-16 * 4096);
+  }
+  return 0;
+}
+
+// Grow the heap lazily, touch every page so it is faulted in,
+// and give it back.
+static int
+lazy(void)
+{
+  char *p;
+
+  for(int i = 0; i < ITERS / 10; i++) {
+    if((p = sbrklazy(16 * 4096)) == SBRK_ERROR)
+      return -1;
+    for(int j = 0; j < 16; j++)
+      p[j * 4096] = j;
+    sbrk(-16 * 4096);
+  }
+  return 0;
+}
+
+// student_malloc/student_free of small and page-sized blocks,
+// 16 live at a time.
+static int
+smalloc(void)
+{
+  void *live[16];
+
+  for(int j = 0; j < 16; j++)
+    live[j] = 0;
+  for(int i = 0; i < ITERS * 4; i++) {
+    student_free(live[i % 16]);
+    live[i % 16] = student_malloc(i % 8 == 0 ? 3000 : 16 + (i * 40) % 1000);
+  }
+  for(int j = 0; j < 16; j++)
+    student_free(live[j]);
+  return 0;
+}
+
+// fork a child that exits right away, and wait for it.
+static int
+forkexit(void)
+{
+  int pid;
+
+  for(int i = 0; i < ITERS / 50; i++) {
+    if((pid = fork()) < 0)
+      return -1;
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  return 0;
+}
+
+struct test {
+  char *name;
+  int (*run)(void); // 0 if it worked
+  int ops;          // done by one worker
+};
+
+static struct test tests[] = {
+  { "sbrk_eager", eager,    ITERS / 10 * 2 },
+  { "sbrk_lazy",  lazy,     ITERS / 10 * 2 },
+  { "malloc",     smalloc,  ITERS * 4 * 2 },
+  { "fork_exit",  forkexit, ITERS / 50 },
+};
+#define NTEST (sizeof(tests) / sizeof(tests[0]))
+
+// Run t in n workers at once. Returns the ticks until all are done,
+// and the total ops in *ops, or -1 if a worker failed.
+static int
+run(struct test *t, int n, int *ops)
+{
+  int fds[2], i, ok = 1, status, t0;
+  char c;
+
+  if(pipe(fds) < 0)
+    return -1;
+  for(i = 0; i < n; i++) {
+    int pid = fork();
+    if(pid < 0) {
+      ok = 0;
+      n = i;
+      break;
+    }
+    if(pid == 0) {
+      close(fds[1]);
+      if(read(fds[0], &c, 1) != 1) // wait for the start
+        exit(1);
+      exit(t->run() < 0);
+    }
+  }
+  close(fds[0]);
+
+  // start them all together
+  t0 = uptime();
+  for(i = 0; i < n; i++)
+    write(fds[1], "x", 1);
+  close(fds[1]);
+  for(i = 0; i < n; i++) {
+    wait(&status);
+    if(status != 0)
+      ok = 0;
+  }
+
+  *ops = n * t->ops;
+  return ok ? uptime() - t0 : -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int max = CPUS, i, n, ticks, ops;
+  char *only = 0;
+
+  for(i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      max = atoi(argv[++i]);
+    } else if(argv[i][0] != '-' && only == 0) {
+      only = argv[i];
+    } else {
+      fprintf(2, "usage: scalebench [-n maxworkers] [test]\n");
+      exit(1);
+    }
+  }
+  if(max < 1)
+    max = 1;
+
+  for(i = 0; i < NTEST; i++) {
+    if(only && strcmp(only, tests[i].name) != 0)
+      continue;
+    for(n = 1; n <= max; n++) {
+      if((ticks = run(&tests[i], n, &ops)) < 0) {
+        fprintf(2, "scalebench: %s with %d workers failed\n", tests[i].name, n);
+        continue;
+      }
+      printf("scalebench,%s,%d,%d,%d\n", tests[i].name, n, ops, ticks);
+    }
+  }
+
+  exit(0);
+}
@@ -0,0 +1,34 @@
+#include "kernel/types.h"
+#include "kernel/memstats.h"
+#include "kernel/student.h"
+#include "user/user.h"
+
+// Read the allocator statistics from the page the kernel maps
+// read-only at USTATS and updates every clock tick, instead of
+// asking with the memstats() system call. Same arguments and
+// result as memstats(); the values are at most a tick old, and
+// strategy is the default one rather than the caller's.
+// Falls back to memstats() until the kernel has published any.
+int
+fastmemstats(struct memstats *st, int size)
+{
+  volatile struct memstats_page *sp = (struct memstats_page*)USTATS;
+  uint seq;
+
+  if(size < 0)
+    return -1;
+  if(size > sizeof(*st))
+    size = sizeof(*st);
+
+  do {
+    while((seq = sp->seq) & 1) // the kernel is writing it
+      ;
+    __sync_synchronize();
+    memmove(st, (void*)&sp->st, size);
+    __sync_synchronize();
+  } while(sp->seq != seq);
+
+  if(seq == 0)
+    return memstats(st, size);
+  return 0;
+}
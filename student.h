@@ -0,0 +1,33 @@
+// User address space window for student_malloc() memory.
+// A student allocator page at physical address pa is mapped
+// at USTUDENT + (pa - KERNBASE) in every process that got
+// memory from it, so a block has the same user address in
+// every process. The window sits between the heap and the
+// trampoline; sbrk() never grows the heap past USTUDENT.
+#define USTUDENT      (1L << 37)
+#define USTUDENT_SIZE (1L << 36)
+#define USTUDENT_TOP  (USTUDENT + USTUDENT_SIZE)
+
+// Shared memory segments from shmget(). Segment id is mapped at
+// USHM + id * SHM_MAXSIZE in every process that attaches it, so
+// pointers into a segment mean the same thing everywhere. The
+// segments sit right above the student window.
+#define NSHM          16
+#define SHM_MAXSIZE   (2L << 20) // 2 MB
+#define USHM          USTUDENT_TOP
+#define USHM_TOP      (USHM + NSHM * SHM_MAXSIZE)
+
+// The read-only struct memstats_page (kernel/memstats.h), one
+// page right above the shared memory segments.
+#define USTATS        USHM_TOP
+
+// Placement strategies for student_malloc(), chosen per process
+// with the student_strategy() system call. The fit strategies
+// place blocks of any size in a shared heap; segregated fit
+// packs small requests into per-size slabs instead.
+#define STRATEGY_FIRST_FIT      0
+#define STRATEGY_BEST_FIT       1
+#define STRATEGY_NEXT_FIT       2
+#define STRATEGY_WORST_FIT      3
+#define STRATEGY_SEGREGATED_FIT 4
+#define NSTRATEGY               5
@@ -104,6 +104,15 @@ extern uint64 sys_close(void);
 extern uint64 sys_getmemstats(void); // added syscall
 extern uint64 sys_student_malloc(void);
 extern uint64 sys_student_free(void);
+extern uint64 sys_student_malloc_batch(void);
+extern uint64 sys_student_free_batch(void);
+extern uint64 sys_memstats(void);
+extern uint64 sys_allochist(void);
+extern uint64 sys_student_strategy(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmattach(void);
+extern uint64 sys_shmdetach(void);
+extern uint64 sys_procmem(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -132,6 +141,15 @@ static uint64 (*syscalls[])(void) = {
 [SYS_getmemstats] sys_getmemstats, // added syscall
 [SYS_student_malloc] sys_student_malloc,
 [SYS_student_free] sys_student_free,
+[SYS_student_malloc_batch] sys_student_malloc_batch,
+[SYS_student_free_batch] sys_student_free_batch,
+[SYS_memstats] sys_memstats,
+[SYS_allochist] sys_allochist,
+[SYS_student_strategy] sys_student_strategy,
+[SYS_shmget] sys_shmget,
+[SYS_shmattach] sys_shmattach,
+[SYS_shmdetach] sys_shmdetach,
+[SYS_procmem] sys_procmem,
 };
 
 void
@@ -23,3 +23,12 @@
 #define SYS_getmemstats 22 // added syscall number
 #define SYS_student_malloc 23
 #define SYS_student_free 24
+#define SYS_student_malloc_batch 25
+#define SYS_student_free_batch 26
+#define SYS_memstats 27
+#define SYS_allochist 28
+#define SYS_student_strategy 29
+#define SYS_shmget 30
+#define SYS_shmattach 31
+#define SYS_shmdetach 32
+#define SYS_procmem 33
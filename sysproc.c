@@ -6,6 +6,9 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "vm.h"
+#include "student.h"
+#include "memstats.h"
+#include "allochist.h"
 
 uint64
 sys_exit(void)
@@ -57,7 +60,7 @@ sys_sbrk(void)
     // memory, vmfault() will allocate it.
     if(addr + n < addr)
       return -1;
-    if(addr + n > TRAPFRAME)
+    if(addr + n > USTUDENT)
       return -1;
     myproc()->sz += n;
   }
@@ -149,11 +152,11 @@ sys_student_malloc(void)
   // Get size argument
   argint(0, (int*)&size);
   
-  // Call kernel allocator
-  void* ptr = student_malloc(size);
+  // Call kernel allocator, it maps the memory into this process
+  uint64 va = student_malloc(myproc(), size);
   
-  // Return pointer as uint64 (0 if allocation failed)
-  return (uint64)ptr;
+  // Return user address (0 if allocation failed)
+  return va;
 }
 
 uint64
@@ -165,7 +168,167 @@ sys_student_free(void)
   argaddr(0, &ptr_addr);
   
   // Call kernel free function
-  student_free((void*)ptr_addr);
+  return student_free(myproc(), ptr_addr);
+}
+
+// Fill in the caller's struct memstats with one copyout.
+// The caller passes its sizeof(struct memstats); an older, smaller
+// struct just gets the fields it knows about.
+uint64
+sys_memstats(void)
+{
+  uint64 addr;
+  int size;
+  struct memstats st;
+  
+  argaddr(0, &addr);
+  argint(1, &size);
+  if(size < 0)
+    return -1;
+  if(size > sizeof(st))
+    size = sizeof(st);
+  
+  student_memstats(&st);
+  st.strategy = student_strategy(myproc(), -1);
+  if(copyout(myproc()->pagetable, addr, (char*)&st, size) < 0)
+    return -1;
+  
+  return 0;
+}
+
+// Copy the allocator histograms, summed over all CPUs, to the
+// caller's struct allochist. A non-zero reset clears them.
+uint64
+sys_allochist(void)
+{
+  uint64 addr;
+  int reset;
+  struct allochist h; // 1 KB, fits on the kernel stack
+  
+  argaddr(0, &addr);
+  argint(1, &reset);
+  
+  allochist_read(&h, reset);
+  if(copyout(myproc()->pagetable, addr, (char*)&h, sizeof(h)) < 0)
+    return -1;
   
   return 0;
 }
+
+// Largest batch for student_malloc_batch/student_free_batch,
+// the arrays live on the kernel stack.
+#define STUDENT_BATCH_MAX 64
+
+uint64
+sys_student_malloc_batch(void)
+{
+  uint64 sizes_addr, ptrs_addr;
+  int n;
+  uint sizes[STUDENT_BATCH_MAX];
+  uint64 ptrs[STUDENT_BATCH_MAX];
+  
+  // Get arguments: user array of sizes, user array for the pointers, count
+  argaddr(0, &sizes_addr);
+  argaddr(1, &ptrs_addr);
+  argint(2, &n);
+  if(n < 0 || n > STUDENT_BATCH_MAX)
+    return -1;
+  
+  // One copyin for all the sizes
+  struct proc *p = myproc();
+  if(copyin(p->pagetable, (char*)sizes, sizes_addr, n * sizeof(uint)) < 0)
+    return -1;
+  
+  int got = student_malloc_batch(p, sizes, ptrs, n);
+  
+  // One copyout for all the pointers
+  if(copyout(p->pagetable, ptrs_addr, (char*)ptrs, n * sizeof(uint64)) < 0) {
+    student_free_batch(p, ptrs, n); // caller can't see them, don't leak them
+    return -1;
+  }
+  
+  return got;
+}
+
+uint64
+sys_student_free_batch(void)
+{
+  uint64 ptrs_addr;
+  int n;
+  uint64 ptrs[STUDENT_BATCH_MAX];
+  
+  // Get arguments: user array of pointers, count
+  argaddr(0, &ptrs_addr);
+  argint(1, &n);
+  if(n < 0 || n > STUDENT_BATCH_MAX)
+    return -1;
+  
+  if(copyin(myproc()->pagetable, (char*)ptrs, ptrs_addr, n * sizeof(uint64)) < 0)
+    return -1;
+  
+  return student_free_batch(myproc(), ptrs, n);
+}
+
+// Choose the caller's student_malloc placement strategy, or
+// query it with -1. Returns the previous strategy.
+uint64
+sys_student_strategy(void)
+{
+  int s;
+
+  argint(0, &s);
+  return student_strategy(myproc(), s);
+}
+
+// Find or make the shared memory segment with a key and size,
+// see shm_get() in kalloc.c.
+uint64
+sys_shmget(void)
+{
+  int key, size;
+
+  argint(0, &key);
+  argint(1, &size);
+  return shm_get(myproc(), key, size);
+}
+
+uint64
+sys_shmattach(void)
+{
+  int id;
+
+  argint(0, &id);
+  return shm_attach(myproc(), id);
+}
+
+uint64
+sys_shmdetach(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shm_detach(myproc(), addr);
+}
+
+// Copy a struct procmem for each process, at most n of them, to
+// the caller's array. Returns how many were copied.
+uint64
+sys_procmem(void)
+{
+  uint64 addr;
+  int n, i, got = 0;
+  struct procmem pm;
+  struct proc *p = myproc();
+
+  argaddr(0, &addr);
+  argint(1, &n);
+
+  for(i = 0; i < NPROC && got < n; i++) {
+    if(memacct_read(i, &pm) < 0)
+      continue;
+    if(copyout(p->pagetable, addr + got * sizeof(pm), (char*)&pm, sizeof(pm)) < 0)
+      return -1;
+    got++;
+  }
+  return got;
+}
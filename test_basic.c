@@ -1,5 +1,6 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/memstats.h"
 #include "user/user.h"
 
 int
@@ -118,7 +119,84 @@ main(int argc, char *argv[])
     }
   }
   printf("\n");
-  
+
+  // Test 6: The memory is really ours to use
+  printf("Test 6: Writing to and reading back allocated memory\n");
+  char *small = student_malloc(100);
+  char *big = student_malloc(64 * 1024);
+  int ok = small != 0 && big != 0;
+  if(ok) {
+    for(int i = 0; i < 100; i++)
+      small[i] = i;
+    for(int i = 0; i < 64 * 1024; i++)
+      big[i] = i % 251;
+    for(int i = 0; i < 100; i++)
+      if(small[i] != (char)i)
+        ok = 0;
+    for(int i = 0; i < 64 * 1024; i++)
+      if(big[i] != (char)(i % 251))
+        ok = 0;
+  }
+  if(ok) {
+    printf("  ✓ 100-byte and 64KB blocks hold what was written\n");
+  } else {
+    printf("  ✗ Allocated memory is not usable\n");
+  }
+  student_free(small);
+  student_free(big);
+
+  // Freeing something that isn't a block is an error, not a crash
+  if(student_free((void*)0x1000) < 0) {
+    printf("  ✓ Bad pointer rejected\n");
+  } else {
+    printf("  ✗ Bad pointer accepted\n");
+  }
+  printf("\n");
+
+  // Test 7: Extended statistics in one call
+  printf("Test 7: Extended statistics (memstats)\n");
+  struct memstats st;
+  void *one = student_malloc(100);
+  if(memstats(&st, sizeof(st)) == 0 && st.version == MEMSTATS_VERSION) {
+    getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+    printf("  Version %d: %d blocks, %d bytes requested, %d bytes reserved (peak %d)\n",
+           st.version, st.num_allocated, st.total_allocated,
+           (int)st.bytes_reserved, (int)st.peak_reserved);
+    printf("  %d allocations and %d frees so far, kmem %d of %d pages free\n",
+           (int)st.nalloc, (int)st.nfree, st.kmem_free, st.kmem_total);
+    if(st.magic == magic && st.num_allocated == num_alloc &&
+       st.bytes_reserved >= st.total_allocated && st.peak_reserved >= st.bytes_reserved &&
+       st.kmem_free < st.kmem_total) {
+      printf("  ✓ memstats agrees with getmemstats\n");
+    } else {
+      printf("  ✗ memstats disagrees with getmemstats\n");
+    }
+  } else {
+    printf("  ✗ memstats failed\n");
+  }
+  student_free(one);
+  printf("\n");
+
+  // Test 8: the same numbers from the stats page, without a system call
+  printf("Test 8: Statistics from the shared stats page (fastmemstats)\n");
+  struct memstats fast;
+  one = student_malloc(100);
+  pause(1); // the page is republished every tick
+  if(fastmemstats(&fast, sizeof(fast)) == 0 && memstats(&st, sizeof(st)) == 0) {
+    printf("  Page: %d blocks, kmem %d of %d pages free\n",
+           fast.num_allocated, fast.kmem_free, fast.kmem_total);
+    if(fast.version == st.version && fast.magic == st.magic &&
+       fast.num_allocated == st.num_allocated && fast.kmem_total == st.kmem_total) {
+      printf("  ✓ Stats page agrees with memstats\n");
+    } else {
+      printf("  ✗ Stats page disagrees with memstats\n");
+    }
+  } else {
+    printf("  ✗ fastmemstats failed\n");
+  }
+  student_free(one);
+  printf("\n");
+
   printf("=== Test Complete ===\n");
   
   exit(0);
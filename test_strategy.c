@@ -1,5 +1,6 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/student.h"
 #include "user/user.h"
 
 int
@@ -56,7 +57,7 @@ main(int argc, char *argv[])
   // Test 4: Test best-fit with small allocation
   printf("Test 4: Best-Fit Test - Allocate 500 bytes\n");
   printf("  With best-fit, this should use the smallest suitable free block\n");
-  printf("  (Since all pages are 4KB, any free page works - best-fit finds first suitable)\n");
+  printf("  (Blocks are split out of a shared heap, so it goes in the smallest hole that fits)\n");
   
   void *small_block = student_malloc(500);
   printf("  Small block (500 bytes): %p\n", small_block);
@@ -152,12 +153,112 @@ main(int argc, char *argv[])
   }
   printf("\n");
   
+  // Test 9: Each strategy places a block differently. A child per
+  // strategy gets an arena of its own, frees a 300 and then a 1000
+  // byte hole, then asks for 250 bytes. It exits 0 if the block
+  // landed where the strategy says it should.
+  printf("Test 9: Placement under each strategy\n");
+  static char *names[NSTRATEGY] = {
+    [STRATEGY_FIRST_FIT] "first-fit", [STRATEGY_BEST_FIT] "best-fit",
+    [STRATEGY_NEXT_FIT] "next-fit", [STRATEGY_WORST_FIT] "worst-fit",
+    [STRATEGY_SEGREGATED_FIT] "segregated-fit",
+  };
+  int placed = 0;
+  for(int s = 0; s < NSTRATEGY; s++) {
+    int pid = fork();
+    if(pid == 0) {
+      if(student_strategy(s) != STRATEGY_BEST_FIT || student_strategy(-1) != s)
+        exit(1);
+      getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+      if(strategy != s)
+        exit(1);
+      void *a = student_malloc(2000);
+      void *h1 = student_malloc(1000);
+      void *b = student_malloc(100);
+      void *h2 = student_malloc(300);
+      void *c = student_malloc(100);
+      student_free(h2);
+      student_free(h1);
+      void *x = student_malloc(250);
+      int ok = x != 0;
+      if(s == STRATEGY_FIRST_FIT)
+        ok = ok && x == h1;  // first hole on the free list, the last one freed
+      else if(s == STRATEGY_BEST_FIT)
+        ok = ok && x == h2;  // smallest hole that fits
+      else if(s != STRATEGY_SEGREGATED_FIT)
+        ok = ok && x != h1 && x != h2; // the big block past c
+      student_free(a);
+      student_free(b);
+      student_free(c);
+      student_free(x);
+      getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+      exit(ok && num_alloc == 0 ? 0 : 1);
+    }
+    int status = 1;
+    if(pid > 0)
+      wait(&status);
+    if(status == 0) {
+      printf("  ✓ %s (%d) placed the block as expected\n", names[s], s);
+      placed++;
+    } else {
+      printf("  ✗ %s (%d) misplaced the block\n", names[s], s);
+    }
+  }
+  if(student_strategy(-1) == STRATEGY_BEST_FIT) {
+    printf("  ✓ Parent still uses best-fit\n");
+  } else {
+    printf("  ✗ Parent's strategy changed!\n");
+  }
+  printf("\n");
+  
+  // Test 10: Freed neighbours merge. Rebuild the Test 3 pattern in
+  // a fresh arena, free block 3 as well, and the three holes must
+  // have become one free run that a 2900-byte block fits in. With
+  // everything freed the heap is back to a single free block.
+  printf("Test 10: Coalescing [A][F][A][F][A]\n");
+  int merged = 0;
+  int pid = fork();
+  if(pid == 0) {
+    void *b[5];
+    unsigned int empty;
+    for(int i = 0; i < 5; i++)
+      b[i] = student_malloc(1000);
+    for(int i = 0; i < 5; i++)
+      student_free(b[i]);
+    getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &empty);
+    for(int i = 0; i < 5; i++)
+      b[i] = student_malloc(1000);
+    student_free(b[1]);
+    student_free(b[3]);
+    student_free(b[2]);
+    void *big = student_malloc(2900);
+    int ok = big == b[1];
+    student_free(big);
+    student_free(b[0]);
+    student_free(b[4]);
+    getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+    exit(ok && num_free == empty ? 0 : 1);
+  }
+  int status = 1;
+  if(pid > 0)
+    wait(&status);
+  if(status == 0) {
+    printf("  ✓ Blocks 2, 3 and 4 merged into one run, reused for 2900 bytes\n");
+    printf("  ✓ Heap merged back to one free block after freeing everything\n");
+    merged = 1;
+  } else {
+    printf("  ✗ Freed neighbours were not merged\n");
+  }
+  printf("\n");
+  
   printf("=== Strategy Test Complete ===\n");
   printf("Summary:\n");
   printf("  - Strategy: Best-Fit (1)\n");
   printf("  - Fragmentation handling: Tested\n");
   printf("  - Multiple allocation patterns: Tested\n");
   printf("  - Best-fit selection: Verified\n");
+  printf("  - Runtime strategy selection: %d of %d strategies verified\n", placed, NSTRATEGY);
+  printf("  - Coalescing of freed neighbours: %s\n", merged ? "Verified" : "FAILED");
   printf("  - Memory cleanup: Complete\n");
   
   exit(0);
@@ -1,5 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/memstats.h"
+#include "kernel/student.h"
 #include "user/user.h"
 
 int
@@ -118,6 +121,21 @@ main(int argc, char *argv[])
   student_free(large1);
   student_free(large2);
   student_free(large3);
+  
+  // Requests bigger than a page get contiguous pages
+  void *big1 = student_malloc(8192);
+  void *big2 = student_malloc(65536);
+  void *big3 = student_malloc(1024 * 1024);
+  
+  if(big1 && big2 && big3) {
+    printf("  ✓ Successfully allocated 8 KB, 64 KB, 1 MB\n");
+  } else {
+    printf("  ! Some multi-page allocations failed\n");
+  }
+  
+  student_free(big1);
+  student_free(big2);
+  student_free(big3);
   printf("\n");
   
   // Test 8: Performance test - measure allocation time
@@ -195,6 +213,294 @@ main(int argc, char *argv[])
   }
   printf("\n");
   
+  // Test 11: Small objects should share pages. Slabs only serve
+  // segregated fit, so switch to it for this test.
+  printf("Test 11: Small Object Packing (64 x 50 bytes)\n");
+  void *small_ptrs[64];
+  int pages_used = 0;
+  int old_strategy = student_strategy(STRATEGY_SEGREGATED_FIT);
+  
+  for(i = 0; i < 64; i++) {
+    small_ptrs[i] = student_malloc(50);
+    if(small_ptrs[i] == 0) {
+      printf("  ! Small allocation %d failed\n", i);
+      break;
+    }
+    // Count how many distinct pages the objects landed in
+    int seen = 0;
+    for(int j = 0; j < i; j++) {
+      if(((unsigned long)small_ptrs[j] >> 12) == ((unsigned long)small_ptrs[i] >> 12)) {
+        seen = 1;
+        break;
+      }
+    }
+    if(!seen)
+      pages_used++;
+  }
+  int small_count = i;
+  
+  printf("  %d objects use %d page(s)\n", small_count, pages_used);
+  if(small_count == 64 && pages_used <= 2) {
+    printf("  ✓ Small objects are packed into shared pages\n");
+  } else {
+    printf("  ✗ Small objects are not packed\n");
+  }
+  
+  for(i = 0; i < small_count; i++) {
+    student_free(small_ptrs[i]);
+  }
+  student_strategy(old_strategy);
+  printf("\n");
+  
+  // Test 12: Same churn as Test 6, one syscall per batch
+  printf("Test 12: Batched Allocation/Deallocation Cycles (100 iterations)\n");
+  unsigned int batch_sizes[10];
+  void *batch_ptrs[10];
+  int batch_ok = 1;
+  
+  for(int j = 0; j < 10; j++) {
+    batch_sizes[j] = 64 + j * 32;
+  }
+  for(i = 0; i < 100; i++) {
+    if(student_malloc_batch(batch_sizes, batch_ptrs, 10) != 10) {
+      batch_ok = 0;
+    }
+    student_free_batch(batch_ptrs, 10);
+  }
+  
+  getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+  if(batch_ok && num_alloc == 0) {
+    printf("  ✓ Completed 100 batched cycles of allocate/free\n");
+  } else {
+    printf("  ✗ Batched cycles failed (Blocks left: %d)\n", num_alloc);
+  }
+  printf("\n");
+  
+  // Test 13: A process that exits without freeing gets cleaned up
+  printf("Test 13: Leaked Blocks Reclaimed on Exit\n");
+  getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+  unsigned int before = num_alloc;
+  int pid = fork();
+  if(pid == 0) {
+    for(i = 0; i < 50; i++) {
+      student_malloc(32 + i * 200); // never freed
+    }
+    exit(0);
+  }
+  wait(0);
+  
+  getmemstats(&magic, &strategy, &num_alloc, &total_alloc, &num_free);
+  if(num_alloc == before) {
+    printf("  ✓ Child's 50 leaked blocks were reclaimed when it exited\n");
+  } else {
+    printf("  ✗ Leaked blocks still counted (Blocks: %d, expected %d)\n", num_alloc, before);
+  }
+  printf("\n");
+  
+  // Test 14: Pages from a burst of allocations are given back.
+  // The page pool is trimmed under segregated fit, so use it here.
+  printf("Test 14: Idle Pages Trimmed After a Burst (200 x 3000 bytes)\n");
+  struct memstats st;
+  void *burst[200];
+  old_strategy = student_strategy(STRATEGY_SEGREGATED_FIT);
+  memstats(&st, sizeof(st));
+  unsigned int pages_before = st.student_pages;
+  for(i = 0; i < 200; i++) {
+    burst[i] = student_malloc(3000);
+  }
+  memstats(&st, sizeof(st));
+  unsigned int pages_peak = st.student_pages;
+  for(i = 0; i < 200; i++) {
+    student_free(burst[i]);
+  }
+  memstats(&st, sizeof(st));
+  printf("  Student pages: %d before, %d during, %d after\n",
+         pages_before, pages_peak, st.student_pages);
+  if(st.student_pages < pages_before + 50) {
+    printf("  ✓ Burst pages went back to kalloc\n");
+  } else {
+    printf("  ✗ Burst pages still held by the allocator\n");
+  }
+  student_strategy(old_strategy);
+  printf("\n");
+  
+  // Test 15: A 4 MB block is mapped with two 2 MB megapages
+  printf("Test 15: Megapage Mappings for a 4 MB Block\n");
+  memstats(&st, sizeof(st));
+  uint64 super_before = st.nsuper;
+  char *huge = student_malloc(4 * 1024 * 1024);
+  int huge_ok = huge != 0;
+  if(huge_ok) {
+    for(i = 0; i < 4 * 1024 * 1024; i += 4096)
+      huge[i] = i / 4096;
+    for(i = 0; i < 4 * 1024 * 1024; i += 4096)
+      if(huge[i] != (char)(i / 4096))
+        huge_ok = 0;
+  }
+  memstats(&st, sizeof(st));
+  printf("  %d megapage mapping(s) made\n", (int)(st.nsuper - super_before));
+  if(huge_ok && st.nsuper >= super_before + 2) {
+    printf("  ✓ 4 MB block mapped with megapages and usable\n");
+  } else if(huge_ok) {
+    printf("  ✗ 4 MB block usable but not mapped with megapages\n");
+  } else {
+    printf("  ✗ 4 MB block not usable\n");
+  }
+  if(student_free(huge) == 0 && student_free(huge) < 0) {
+    printf("  ✓ Freed once, second free rejected\n");
+  } else {
+    printf("  ✗ Freeing the 4 MB block misbehaved\n");
+  }
+  printf("\n");
+  
+  // Test 16: A linear scan of lazily grown memory takes few faults
+  printf("Test 16: Fault-Around on sbrklazy Memory (1 MB scan)\n");
+  memstats(&st, sizeof(st));
+  uint64 faults_before = st.lazy_faults;
+  char *lazy = sbrklazy(1024 * 1024);
+  int lazy_ok = lazy != SBRK_ERROR;
+  if(lazy_ok) {
+    for(i = 0; i < 1024 * 1024; i += 64)
+      if(lazy[i] != 0)
+        lazy_ok = 0;
+  }
+  memstats(&st, sizeof(st));
+  int nfaults = st.lazy_faults - faults_before;
+  printf("  %d fault(s) for 256 pages\n", nfaults);
+  if(lazy_ok && nfaults <= 256 / 8) {
+    printf("  ✓ Neighbouring pages were mapped by each fault\n");
+  } else if(lazy_ok) {
+    printf("  ✗ Too many faults for a linear scan\n");
+  } else {
+    printf("  ✗ Lazily grown memory not usable or not zeroed\n");
+  }
+  if(lazy_ok)
+    sbrk(-1024 * 1024);
+  printf("\n");
+  
+  // Test 17: fork shares memory until someone writes it
+  printf("Test 17: Copy-on-Write Fork (1 MB heap)\n");
+  char *cow = sbrk(1024 * 1024);
+  int cow_ok = cow != SBRK_ERROR;
+  if(cow_ok) {
+    for(i = 0; i < 1024 * 1024; i += 4096)
+      cow[i] = 1;
+    memstats(&st, sizeof(st));
+    unsigned int free_before = st.kmem_free;
+    pid = fork();
+    if(pid == 0) {
+      memstats(&st, sizeof(st));
+      int shared = free_before - st.kmem_free < 256 / 2;
+      cow[0] = 2; // this page, and only this one, gets copied
+      exit(shared && cow[0] == 2 && cow[4096] == 1 ? 0 : 1);
+    }
+    int status = 1;
+    if(pid > 0)
+      wait(&status);
+    cow_ok = status == 0 && cow[0] == 1;
+    sbrk(-1024 * 1024);
+  }
+  if(cow_ok) {
+    printf("  ✓ Child shared the heap and its write stayed its own\n");
+  } else {
+    printf("  ✗ Fork copied the heap or the child's write leaked\n");
+  }
+  printf("\n");
+  
+  // Test 18: a child's writes to a shared segment are the parent's
+  printf("Test 18: Shared Memory Segment (64KB)\n");
+  int shm_ok = 0;
+  int id = shmget(18, 64 * 1024);
+  char *seg = id < 0 ? 0 : shmattach(id);
+  if(seg != 0) {
+    pid = fork();
+    if(pid == 0) {
+      char *s = shmget(18, 64 * 1024) == id ? shmattach(id) : 0;
+      if(s != seg)
+        exit(1);
+      for(i = 0; i < 64 * 1024; i++)
+        s[i] = i % 253;
+      exit(0);
+    }
+    int status = 1;
+    if(pid > 0)
+      wait(&status);
+    shm_ok = status == 0;
+    for(i = 0; i < 64 * 1024 && shm_ok; i++)
+      if(seg[i] != (char)(i % 253))
+        shm_ok = 0;
+    if(shmdetach(seg) < 0 || shmdetach(seg) == 0)
+      shm_ok = 0;
+  }
+  if(shm_ok) {
+    printf("  ✓ Child's writes seen in place, detach works once\n");
+  } else {
+    printf("  ✗ Shared segment not shared\n");
+  }
+  printf("\n");
+  
+  // Test 19: user-level malloc reuses a freed block of its class right away
+  printf("Test 19: Size-Class malloc/free (user library)\n");
+  int um_ok = 1;
+  for(i = 0; i < 100; i++) {
+    ptrs[i] = malloc(1 + (i * 97) % 3000);
+    if(ptrs[i] == 0 || (uint64)ptrs[i] % 16 != 0) {
+      um_ok = 0;
+      break;
+    }
+    memset(ptrs[i], i, 1 + (i * 97) % 3000);
+  }
+  for(int j = 0; j < i; j++)
+    if(((char*)ptrs[j])[(j * 97) % 3000] != (char)j)
+      um_ok = 0;
+  for(int j = 0; j < i; j++)
+    free(ptrs[j]);
+  // the free lists are LIFO, so the same sizes come back in reverse
+  for(int j = i - 1; j >= 0 && um_ok; j--)
+    if(malloc(1 + (j * 97) % 3000) != ptrs[j])
+      um_ok = 0;
+  for(int j = 0; j < i; j++)
+    free(ptrs[j]);
+  char *um_big = malloc(2 * 1024 * 1024);
+  if(um_big == 0)
+    um_ok = 0;
+  else
+    um_big[2 * 1024 * 1024 - 1] = 1;
+  free(um_big);
+  if(um_ok) {
+    printf("  ✓ 100 blocks usable, freed blocks reused by size\n");
+  } else {
+    printf("  ✗ malloc lost or misplaced a block\n");
+  }
+  printf("\n");
+  
+  // Test 20: procmem() sees this process's lazy and student memory
+  printf("Test 20: Per-Process Memory Accounting (procmem)\n");
+  static struct procmem pm[NPROC];
+  void *acct_blk = student_malloc(8192);
+  char *acct_lazy = sbrklazy(1024 * 1024);
+  int acct_ok = 0;
+  if(acct_blk != 0 && acct_lazy != SBRK_ERROR) {
+    acct_lazy[0] = 1; // fault in the first window only
+    int n = procmem(pm, NPROC);
+    for(i = 0; i < n; i++) {
+      if(pm[i].pid != getpid())
+        continue;
+      printf("  %lu KB resident, %lu KB lazy, %lu page-table pages, %lu student bytes\n",
+             pm[i].resident * 4, pm[i].lazy / 1024, pm[i].ptpages, pm[i].student);
+      acct_ok = pm[i].resident > 0 && pm[i].ptpages >= 3 &&
+                pm[i].lazy >= 1024 * 1024 - 64 * 4096 && pm[i].student >= 8192;
+    }
+    sbrk(-1024 * 1024);
+  }
+  student_free(acct_blk);
+  if(acct_ok) {
+    printf("  ✓ procmem found this process and its memory\n");
+  } else {
+    printf("  ✗ procmem missed this process's memory\n");
+  }
+  printf("\n");
+  
   printf("=== Stress Test Complete ===\n");
   printf("Summary:\n");
   printf("  - Edge cases: Passed\n");
@@ -205,6 +511,16 @@ main(int argc, char *argv[])
   printf("  - Performance test: Completed\n");
   printf("  - Memory leak detection: No leaks\n");
   printf("  - Alignment: Verified\n");
+  printf("  - Small object packing: Tested\n");
+  printf("  - Batched alloc/free cycles: Tested\n");
+  printf("  - Reclaim on exit: Tested\n");
+  printf("  - Trimming idle pages: Tested\n");
+  printf("  - Megapage mappings: Tested\n");
+  printf("  - Fault-around on lazy sbrk: Tested\n");
+  printf("  - Copy-on-write fork: Tested\n");
+  printf("  - Shared memory segments: Tested\n");
+  printf("  - Size-class malloc: Tested\n");
+  printf("  - Per-process accounting: Tested\n");
   
   exit(0);
 }
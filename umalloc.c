@@ -0,0 +1,115 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Memory allocator with size classes, replacing xv6's K&R
+// first-fit list.
+//
+// Every block starts with a 16-byte header and is rounded up to
+// the size of its class: multiples of 16 bytes up to 128, then
+// four classes per power of two, so no more than a quarter of
+// a block is rounding. Each class has its own free list, so
+// malloc() pops a free block of the class or carves a new one
+// off the end of the current chunk, and free() pushes the block
+// back; neither walks anything. Chunks come from sbrklazy() a
+// megabyte or more at a time, so pages are only faulted in once
+// a block on them is used, and freed blocks are kept for reuse
+// by their class rather than given back to the kernel.
+
+typedef long Align;
+
+union header {
+  struct {
+    uint size;            // block size, header included
+    uint cls;             // size class
+    union header *next;   // next free block of the class, while free
+  } s;
+  Align x[2];
+};
+
+typedef union header Header;
+
+#define NCLASS   100              // blocks up to 2^30 bytes
+#define MAXALLOC ((1 << 30) - 16) // largest request
+#define CHUNK    (1024 * 1024)    // least sbrklazy() growth
+
+static Header *freelist[NCLASS];
+static char *bump;                // the unused end of the chunk
+static char *limit;               // end of the chunk
+
+// The class of a block of n bytes, header included, and in
+// *size the block size it rounds up to.
+static int
+size_class(uint n, uint *size)
+{
+  uint step;
+  int lg;
+
+  if(n <= 128){
+    *size = (n + 15) & ~15;
+    return *size / 16 - 1;
+  }
+  for(lg = 7; (1u << (lg + 1)) < n; lg++)
+    ;
+  // 2^lg < n <= 2^(lg+1): four classes of step bytes apart
+  step = 1u << (lg - 2);
+  *size = (n + step - 1) & ~(step - 1);
+  return 8 + (lg - 7) * 4 + (*size >> (lg - 2)) - 5;
+}
+
+// Make room for at least n more bytes at bump. Memory that
+// follows on from the current chunk extends it; otherwise (some
+// other code moved the break) what was left of the chunk is
+// given up and a new one starts.
+static int
+morecore(uint n)
+{
+  char *p;
+
+  n += 16; // room to align a new chunk
+  if(n < CHUNK)
+    n = CHUNK;
+  if((p = sbrklazy(n)) == SBRK_ERROR)
+    return -1;
+  if(p != limit)
+    bump = (char*)(((uint64)p + 15) & ~15);
+  limit = p + n;
+  return 0;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  bp->s.next = freelist[bp->s.cls];
+  freelist[bp->s.cls] = bp;
+}
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint size;
+  int cls;
+
+  if(nbytes > MAXALLOC)
+    return 0;
+  cls = size_class(nbytes + sizeof(Header), &size);
+
+  if((p = freelist[cls]) != 0){
+    freelist[cls] = p->s.next;
+    return (void*)(p + 1);
+  }
+
+  if(limit - bump < size && morecore(size) < 0)
+    return 0;
+  p = (Header*)bump;
+  bump += size;
+  p->s.size = size;
+  p->s.cls = cls;
+  return (void*)(p + 1);
+}
@@ -1,6 +1,9 @@
 #define SBRK_ERROR ((char *)-1)
 
 struct stat;
+struct memstats;
+struct allochist;
+struct procmem;
 
 // system calls
 int fork(void);
@@ -26,7 +29,16 @@ int pause(int);
 int uptime(void); // added syscall prototype
 int getmemstats(unsigned int*, unsigned int*, unsigned int*, unsigned int*, unsigned int*);
 void* student_malloc(unsigned int);
-void student_free(void*);
+int student_free(void*);
+int student_malloc_batch(unsigned int*, void**, int); // at most 64 per call
+int student_free_batch(void**, int);
+int memstats(struct memstats*, int); // fills in at most size bytes
+int allochist(struct allochist*, int); // non-zero reset clears the counts after reading
+int student_strategy(int); // STRATEGY_* from kernel/student.h, -1 to query; returns the old one
+int shmget(int, int); // key > 0, size up to SHM_MAXSIZE; returns a segment id
+void* shmattach(int); // same address in every process, 0 on error
+int shmdetach(void*);
+int procmem(struct procmem*, int); // one entry per process, at most n; returns how many
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -50,3 +62,6 @@ void printf(const char*, ...) __attribute__ ((format (printf, 1, 2)));
 // umalloc.c
 void* malloc(uint);
 void free(void*);
+
+// statpage.c
+int fastmemstats(struct memstats*, int); // memstats() from the stats page, no system call; up to a tick old
@@ -46,3 +46,12 @@ entry("uptime");
 entry("getmemstats");
 entry("student_malloc");
 entry("student_free");
+entry("student_malloc_batch");
+entry("student_free_batch");
+entry("memstats");
+entry("allochist");
+entry("student_strategy");
+entry("shmget");
+entry("shmattach");
+entry("shmdetach");
+entry("procmem");